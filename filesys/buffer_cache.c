@@ -0,0 +1,444 @@
+/* buffer_cache.c: Sector cache in front of the file system disk.
+ *
+ * All I/O to filesys_disk goes through BC_SIZE cached sectors.  They
+ * are found by sector number through a hash table and replaced with a
+ * clock sweep.  A write only dirties the cached copy: the flusher
+ * thread writes dirty sectors back every BC_FLUSH_INTERVAL ticks,
+ * eviction writes back its victim, and buffer_cache_done() writes the
+ * rest at shutdown.  No disk I/O happens under bc_lock.  A read-ahead thread loads the sector following
+ * each read in the background.
+ *
+ * Once the VM's page cache is up, it holds file data itself and moves
+ * it with the _direct calls, which do not fill this cache, so that
+ * the buffer cache is left with inodes and other metadata. */
+
+#include "filesys/buffer_cache.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "devices/timer.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define BC_SIZE 64							/* Cached sectors (32 kB). */
+#define BC_FLUSH_INTERVAL (5 * TIMER_FREQ)	/* Ticks between write-behinds. */
+#define BC_RA_QUEUE 16						/* Pending read-ahead requests. */
+
+/* One cached sector. */
+struct bc_entry {
+	struct hash_elem elem;				/* Element in bc_index. */
+	disk_sector_t sector;				/* Sector held, if IN_USE. */
+	bool in_use;						/* In bc_index. */
+	bool accessed;						/* Used since the last sweep. */
+	int pin_cnt;						/* Users; pinned entries stay. */
+
+	struct lock lock;					/* Protects the fields below. */
+	bool valid;							/* DATA holds the sector. */
+	bool dirty;							/* DATA is newer than the disk. */
+	uint8_t data[DISK_SECTOR_SIZE];
+};
+
+static struct bc_entry cache[BC_SIZE];
+
+/* bc_lock protects bc_index, the clock and each entry's fields above
+ * its lock.  An entry's data is only touched while it is pinned. */
+static struct hash bc_index;
+static struct lock bc_lock;
+static struct condition bc_unpinned;	/* Signaled when a pin drops to 0. */
+static size_t clock_hand;
+
+/* Sectors waiting for the read-ahead thread.  Protected by bc_lock. */
+static disk_sector_t ra_queue[BC_RA_QUEUE];
+static size_t ra_head, ra_len;
+static struct semaphore ra_sema;
+
+/* Statistics. */
+static long long hit_cnt;				/* # of accesses that found the sector. */
+static long long miss_cnt;				/* # of them that did not. */
+static long long ra_read_cnt;			/* # of sectors read ahead. */
+static long long flush_write_cnt;		/* # of sectors written behind. */
+static long long evict_write_cnt;		/* # of dirty sectors evicted. */
+static long long direct_cnt;			/* # of uncached sector transfers. */
+static long long direct_run_cnt;		/* # of multi-sector uncached writes. */
+
+static void bc_flushd (void *aux);
+static void bc_readaheadd (void *aux);
+
+static uint64_t
+bc_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_int (hash_entry (e, struct bc_entry, elem)->sector);
+}
+
+static bool
+bc_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct bc_entry, elem)->sector
+		< hash_entry (b, struct bc_entry, elem)->sector;
+}
+
+/* Initializes the buffer cache and starts its threads. */
+void
+buffer_cache_init (void) {
+	for (size_t i = 0; i < BC_SIZE; i++)
+		lock_init (&cache[i].lock);
+	hash_init (&bc_index, bc_hash, bc_less, NULL);
+	lock_init (&bc_lock);
+	cond_init (&bc_unpinned);
+	sema_init (&ra_sema, 0);
+	thread_create ("bc_flushd", PRI_DEFAULT, bc_flushd, NULL);
+	thread_create ("bc_readaheadd", PRI_DEFAULT, bc_readaheadd, NULL);
+}
+
+/* Returns the cached entry for SECTOR, or a null pointer.
+ * Must be called with bc_lock held. */
+static struct bc_entry *
+bc_lookup (disk_sector_t sector) {
+	struct bc_entry key;
+	struct hash_elem *e;
+
+	key.sector = sector;
+	e = hash_find (&bc_index, &key.elem);
+	return e != NULL ? hash_entry (e, struct bc_entry, elem) : NULL;
+}
+
+/* Sweeps the clock for a free or unpinned, not recently used entry,
+ * writing it back if it is dirty, and returns it free.  Returns a null
+ * pointer if every entry is pinned.  Must be called with bc_lock
+ * held, which is released while a victim is written. */
+static struct bc_entry *
+bc_evict (void) {
+	for (size_t i = 0; i < 2 * BC_SIZE; i++) {
+		struct bc_entry *e = &cache[clock_hand];
+		clock_hand = (clock_hand + 1) % BC_SIZE;
+
+		if (!e->in_use)
+			return e;
+		if (e->pin_cnt > 0)
+			continue;
+		if (e->accessed) {
+			e->accessed = false;
+			continue;
+		}
+
+		/* Nobody holds E's lock, since it is not pinned.  E stays
+		 * cached and pinned while it is written, so no one reads the
+		 * sector from disk before it lands there.  It is taken only if
+		 * nobody used it meanwhile. */
+		if (e->dirty) {
+			e->pin_cnt++;
+			lock_release (&bc_lock);
+			lock_acquire (&e->lock);
+			if (e->dirty) {
+				disk_write (filesys_disk, e->sector, e->data);
+				e->dirty = false;
+				evict_write_cnt++;
+			}
+			lock_release (&e->lock);
+			lock_acquire (&bc_lock);
+			if (--e->pin_cnt > 0 || e->accessed || e->dirty) {
+				if (e->pin_cnt == 0)
+					cond_signal (&bc_unpinned, &bc_lock);
+				continue;
+			}
+		}
+		hash_delete (&bc_index, &e->elem);
+		e->in_use = false;
+		return e;
+	}
+	return NULL;
+}
+
+/* Returns the entry for SECTOR pinned, allocating one if it is not
+ * cached.  A newly allocated entry is not valid yet. */
+static struct bc_entry *
+bc_get (disk_sector_t sector) {
+	struct bc_entry *e;
+
+	lock_acquire (&bc_lock);
+	while ((e = bc_lookup (sector)) == NULL) {
+		e = bc_evict ();
+		if (e == NULL) {
+			/* Every entry is in use; SECTOR may be cached meanwhile. */
+			cond_wait (&bc_unpinned, &bc_lock);
+			continue;
+		}
+		/* SECTOR may have been cached while a victim was written;
+		 * then E just stays free. */
+		if (bc_lookup (sector) != NULL)
+			continue;
+		e->sector = sector;
+		e->in_use = true;
+		e->valid = false;
+		e->dirty = false;
+		hash_insert (&bc_index, &e->elem);
+		break;
+	}
+	e->pin_cnt++;
+	e->accessed = true;
+	lock_release (&bc_lock);
+	return e;
+}
+
+/* Drops a pin taken by bc_get(). */
+static void
+bc_put (struct bc_entry *e) {
+	lock_acquire (&bc_lock);
+	ASSERT (e->pin_cnt > 0);
+	if (--e->pin_cnt == 0)
+		cond_signal (&bc_unpinned, &bc_lock);
+	lock_release (&bc_lock);
+}
+
+/* Copies SIZE bytes at OFS of SECTOR into or out of BUFFER.  The
+ * sector is read from disk first unless it is cached or a write
+ * covers all of it. */
+static void
+bc_access (disk_sector_t sector, void *buffer, int ofs, int size,
+		bool write) {
+	struct bc_entry *e;
+
+	ASSERT (ofs >= 0 && size >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	e = bc_get (sector);
+	lock_acquire (&e->lock);
+	if (e->valid)
+		hit_cnt++;
+	else {
+		miss_cnt++;
+		if (!(write && size == DISK_SECTOR_SIZE))
+			disk_read (filesys_disk, sector, e->data);
+		e->valid = true;
+	}
+
+	if (write) {
+		memcpy (e->data + ofs, buffer, size);
+		e->dirty = true;
+	} else
+		memcpy (buffer, e->data + ofs, size);
+	lock_release (&e->lock);
+	bc_put (e);
+}
+
+/* Reads SECTOR into BUFFER, which must be DISK_SECTOR_SIZE bytes. */
+void
+buffer_cache_read (disk_sector_t sector, void *buffer) {
+	bc_access (sector, buffer, 0, DISK_SECTOR_SIZE, false);
+}
+
+/* Writes DISK_SECTOR_SIZE bytes from BUFFER to SECTOR. */
+void
+buffer_cache_write (disk_sector_t sector, const void *buffer) {
+	bc_access (sector, (void *) buffer, 0, DISK_SECTOR_SIZE, true);
+}
+
+/* Writes DISK_SECTOR_SIZE bytes from BUFFER to SECTOR, on disk right
+ * away as well as in the cache. */
+void
+buffer_cache_write_through (disk_sector_t sector, const void *buffer) {
+	struct bc_entry *e = bc_get (sector);
+
+	lock_acquire (&e->lock);
+	if (e->valid)
+		hit_cnt++;
+	else
+		miss_cnt++;
+	memcpy (e->data, buffer, DISK_SECTOR_SIZE);
+	disk_write (filesys_disk, sector, e->data);
+	e->valid = true;
+	e->dirty = false;
+	lock_release (&e->lock);
+	bc_put (e);
+}
+
+/* Reads SIZE bytes at byte OFS of SECTOR into BUFFER. */
+void
+buffer_cache_read_at (disk_sector_t sector, void *buffer, int ofs, int size) {
+	bc_access (sector, buffer, ofs, size, false);
+}
+
+/* Writes SIZE bytes from BUFFER at byte OFS of SECTOR. */
+void
+buffer_cache_write_at (disk_sector_t sector, const void *buffer, int ofs,
+		int size) {
+	bc_access (sector, (void *) buffer, ofs, size, true);
+}
+
+/* Copies SIZE bytes at OFS of SECTOR into or out of BUFFER without
+ * caching the sector.  A cached copy is still used, since it may be
+ * newer than the disk. */
+static void
+bc_access_direct (disk_sector_t sector, void *buffer, int ofs, int size,
+		bool write) {
+	struct bc_entry *e;
+
+	lock_acquire (&bc_lock);
+	e = bc_lookup (sector);
+	if (e != NULL)
+		e->pin_cnt++;
+	lock_release (&bc_lock);
+
+	if (e != NULL) {
+		bc_access (sector, buffer, ofs, size, write);
+		bc_put (e);
+		return;
+	}
+
+	direct_cnt++;
+	if (size == DISK_SECTOR_SIZE) {
+		if (write)
+			disk_write (filesys_disk, sector, buffer);
+		else
+			disk_read (filesys_disk, sector, buffer);
+	} else {
+		uint8_t bounce[DISK_SECTOR_SIZE];
+
+		disk_read (filesys_disk, sector, bounce);
+		if (write) {
+			memcpy (bounce + ofs, buffer, size);
+			disk_write (filesys_disk, sector, bounce);
+		} else
+			memcpy (buffer, bounce + ofs, size);
+	}
+}
+
+/* Reads SIZE bytes at byte OFS of SECTOR into BUFFER, bypassing the
+ * cache unless it holds SECTOR already. */
+void
+buffer_cache_read_direct (disk_sector_t sector, void *buffer, int ofs,
+		int size) {
+	bc_access_direct (sector, buffer, ofs, size, false);
+}
+
+/* Writes SIZE bytes from BUFFER at byte OFS of SECTOR, bypassing the
+ * cache unless it holds SECTOR already. */
+void
+buffer_cache_write_direct (disk_sector_t sector, const void *buffer, int ofs,
+		int size) {
+	bc_access_direct (sector, (void *) buffer, ofs, size, true);
+}
+
+/* Writes CNT whole sectors from BUFFER starting at SECTOR, bypassing
+ * the cache, in one disk command if the cache holds none of them.
+ * File data sectors enter the cache only while being allocated, so
+ * none of these, which are allocated, can be cached meanwhile. */
+void
+buffer_cache_write_direct_sectors (disk_sector_t sector, size_t cnt,
+		const void *buffer) {
+	bool cached = false;
+
+	ASSERT (cnt <= DISK_MAX_SECTORS);
+
+	lock_acquire (&bc_lock);
+	for (size_t i = 0; i < cnt && !cached; i++)
+		cached = bc_lookup (sector + i) != NULL;
+	lock_release (&bc_lock);
+
+	if (cached) {
+		for (size_t i = 0; i < cnt; i++)
+			bc_access_direct (sector + i,
+					(uint8_t *) buffer + i * DISK_SECTOR_SIZE, 0,
+					DISK_SECTOR_SIZE, true);
+		return;
+	}
+
+	disk_write_sectors (filesys_disk, sector, cnt, buffer);
+	direct_cnt += cnt;
+	direct_run_cnt++;
+}
+
+/* Asks for SECTOR to be read into the cache in the background.
+ * Does nothing if it is cached already or too many requests are
+ * pending. */
+void
+buffer_cache_read_ahead (disk_sector_t sector) {
+	lock_acquire (&bc_lock);
+	if (bc_lookup (sector) == NULL && ra_len < BC_RA_QUEUE) {
+		ra_queue[(ra_head + ra_len++) % BC_RA_QUEUE] = sector;
+		sema_up (&ra_sema);
+	}
+	lock_release (&bc_lock);
+}
+
+/* Read-ahead thread: loads the queued sectors. */
+static void
+bc_readaheadd (void *aux UNUSED) {
+	for (;;) {
+		disk_sector_t sector;
+		struct bc_entry *e;
+
+		sema_down (&ra_sema);
+		lock_acquire (&bc_lock);
+		sector = ra_queue[ra_head];
+		ra_head = (ra_head + 1) % BC_RA_QUEUE;
+		ra_len--;
+		lock_release (&bc_lock);
+
+		e = bc_get (sector);
+		lock_acquire (&e->lock);
+		if (!e->valid) {
+			disk_read (filesys_disk, sector, e->data);
+			e->valid = true;
+			ra_read_cnt++;
+		}
+		lock_release (&e->lock);
+		bc_put (e);
+	}
+}
+
+/* Writes every dirty cached sector back to disk. */
+void
+buffer_cache_flush (void) {
+	for (size_t i = 0; i < BC_SIZE; i++) {
+		struct bc_entry *e = &cache[i];
+
+		lock_acquire (&bc_lock);
+		if (!e->in_use || !e->dirty) {
+			lock_release (&bc_lock);
+			continue;
+		}
+		e->pin_cnt++;
+		lock_release (&bc_lock);
+
+		lock_acquire (&e->lock);
+		if (e->dirty) {
+			disk_write (filesys_disk, e->sector, e->data);
+			e->dirty = false;
+			flush_write_cnt++;
+		}
+		lock_release (&e->lock);
+		bc_put (e);
+	}
+}
+
+/* Write-behind thread. */
+static void
+bc_flushd (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (BC_FLUSH_INTERVAL);
+		/* Free map changes since the last flush go out with it. */
+		free_map_sync ();
+		buffer_cache_flush ();
+	}
+}
+
+/* Writes back everything at shutdown. */
+void
+buffer_cache_done (void) {
+	buffer_cache_flush ();
+}
+
+/* Prints buffer cache statistics. */
+void
+buffer_cache_print_stats (void) {
+	long long lookups = hit_cnt + miss_cnt;
+
+	printf ("Buffer cache: %lld hits, %lld misses (hit rate %lld%%), "
+			"%lld sectors read ahead\n", hit_cnt, miss_cnt,
+			lookups ? hit_cnt * 100 / lookups : 0, ra_read_cnt);
+	printf ("Buffer cache: %lld sectors written behind, %lld on eviction, "
+			"%lld transferred uncached (%lld multi-sector writes)\n",
+			flush_write_cnt, evict_write_cnt, direct_cnt, direct_run_cnt);
+}
@@ -0,0 +1,191 @@
+/* dentry.c: Cache of name lookups.
+ *
+ * Maps (directory inode sector, name) to the inode sector the name
+ * refers to, or records that the directory has no such name.  Hits
+ * open the file without opening or reading its directory.  At most
+ * DENTRY_MAX entries are kept, and the least recently used one is
+ * replaced.
+ *
+ * directory.c keeps the cache right: dir_add() and dir_remove() set
+ * the entry they change, and dir_create() forgets every entry under a
+ * directory sector that is being reused. */
+
+#include "filesys/dentry.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+#define DENTRY_MAX 256                  /* Cached names. */
+#define DENTRY_NEGATIVE ((disk_sector_t) -1)
+
+/* One cached name. */
+struct dentry {
+	disk_sector_t parent;               /* Directory's inode sector. */
+	char name[NAME_MAX + 1];            /* Null terminated file name. */
+	disk_sector_t sector;               /* File's inode sector, or
+	                                       DENTRY_NEGATIVE if none. */
+	struct hash_elem elem;              /* Element in dentries. */
+	struct list_elem lru_elem;          /* Element in lru, most recent first. */
+};
+
+static struct hash dentries;
+static struct list lru;
+static struct lock dentry_lock;
+
+/* Statistics. */
+static long long hit_cnt;               /* # of lookups answered by a name. */
+static long long negative_hit_cnt;      /* # answered by a missing name. */
+static long long miss_cnt;              /* # of lookups not cached. */
+static long long evict_cnt;             /* # of entries replaced. */
+
+static uint64_t
+dentry_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct dentry *d = hash_entry (e, struct dentry, elem);
+	return hash_string (d->name) ^ hash_int (d->parent);
+}
+
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct dentry *a = hash_entry (a_, struct dentry, elem);
+	const struct dentry *b = hash_entry (b_, struct dentry, elem);
+	if (a->parent != b->parent)
+		return a->parent < b->parent;
+	return strcmp (a->name, b->name) < 0;
+}
+
+/* Initializes the dentry cache. */
+void
+dentry_init (void) {
+	if (!hash_init (&dentries, dentry_hash, dentry_less, NULL))
+		PANIC ("dentry cache creation failed");
+	list_init (&lru);
+	lock_init (&dentry_lock);
+}
+
+/* Returns the entry for NAME in PARENT, or a null pointer.  Names
+ * longer than NAME_MAX are never cached, and must not be cut down to
+ * match a shorter one that is.  Must be called with dentry_lock held. */
+static struct dentry *
+dentry_find (disk_sector_t parent, const char *name) {
+	struct dentry key;
+	struct hash_elem *e;
+
+	if (strlen (name) > NAME_MAX)
+		return NULL;
+	key.parent = parent;
+	strlcpy (key.name, name, sizeof key.name);
+	e = hash_find (&dentries, &key.elem);
+	return e != NULL ? hash_entry (e, struct dentry, elem) : NULL;
+}
+
+/* Looks NAME up in the directory whose inode is in sector PARENT.
+ * If the cache knows the answer, sets *CACHED to true and returns the
+ * file's inode opened, or a null pointer if PARENT has no such name.
+ * Otherwise, including for names too long to be cached, sets *CACHED
+ * to false and returns a null pointer.
+ * The inode is opened with the lock held, so that dir_remove() cannot
+ * free it in between. */
+struct inode *
+dentry_open (disk_sector_t parent, const char *name, bool *cached) {
+	struct inode *inode = NULL;
+	struct dentry *d;
+
+	lock_acquire (&dentry_lock);
+	d = dentry_find (parent, name);
+	*cached = d != NULL;
+	if (d == NULL)
+		miss_cnt++;
+	else {
+		list_remove (&d->lru_elem);
+		list_push_front (&lru, &d->lru_elem);
+		if (d->sector == DENTRY_NEGATIVE)
+			negative_hit_cnt++;
+		else {
+			inode = inode_open (d->sector);
+			hit_cnt++;
+		}
+	}
+	lock_release (&dentry_lock);
+	return inode;
+}
+
+/* Records that NAME in PARENT refers to the inode in SECTOR, or to no
+ * inode if SECTOR is DENTRY_NEGATIVE.  Names too long to be in any
+ * directory are not cached. */
+static void
+dentry_update (disk_sector_t parent, const char *name, disk_sector_t sector) {
+	struct dentry *d;
+
+	if (strlen (name) > NAME_MAX)
+		return;
+
+	lock_acquire (&dentry_lock);
+	d = dentry_find (parent, name);
+	if (d != NULL)
+		list_remove (&d->lru_elem);
+	else {
+		if (hash_size (&dentries) < DENTRY_MAX)
+			d = malloc (sizeof *d);
+		else {
+			d = list_entry (list_pop_back (&lru), struct dentry, lru_elem);
+			hash_delete (&dentries, &d->elem);
+			evict_cnt++;
+		}
+		if (d == NULL) {
+			lock_release (&dentry_lock);
+			return;
+		}
+		d->parent = parent;
+		strlcpy (d->name, name, sizeof d->name);
+		hash_insert (&dentries, &d->elem);
+	}
+	d->sector = sector;
+	list_push_front (&lru, &d->lru_elem);
+	lock_release (&dentry_lock);
+}
+
+/* Records that NAME in PARENT refers to the inode in SECTOR. */
+void
+dentry_set (disk_sector_t parent, const char *name, disk_sector_t sector) {
+	ASSERT (sector != DENTRY_NEGATIVE);
+	dentry_update (parent, name, sector);
+}
+
+/* Records that PARENT has no file named NAME. */
+void
+dentry_set_negative (disk_sector_t parent, const char *name) {
+	dentry_update (parent, name, DENTRY_NEGATIVE);
+}
+
+/* Forgets every name cached for the directory in sector PARENT. */
+void
+dentry_forget_dir (disk_sector_t parent) {
+	struct list_elem *e;
+
+	lock_acquire (&dentry_lock);
+	for (e = list_begin (&lru); e != list_end (&lru);) {
+		struct dentry *d = list_entry (e, struct dentry, lru_elem);
+		e = list_next (e);
+		if (d->parent == parent) {
+			list_remove (&d->lru_elem);
+			hash_delete (&dentries, &d->elem);
+			free (d);
+		}
+	}
+	lock_release (&dentry_lock);
+}
+
+/* Prints dentry cache statistics. */
+void
+dentry_print_stats (void) {
+	printf ("Dentry cache: %lld hits, %lld negative hits, %lld misses, "
+			"%lld evictions\n",
+			hit_cnt, negative_hit_cnt, miss_cnt, evict_cnt);
+}
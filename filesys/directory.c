@@ -1,10 +1,13 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include "filesys/dentry.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* A directory. */
 struct dir {
@@ -19,10 +22,72 @@ struct dir_entry {
 	bool in_use;                        /* In use or free? */
 };
 
+/* In-memory state of one directory: the lock that serializes
+ * lookups and changes in it, and an index of its entries, built by
+ * reading the directory once on first access.  Lookups, adds and
+ * removes then touch only the entry they change.  The on-disk format
+ * is unchanged, so dir_readdir() still reads the directory itself. */
+struct dir_index {
+	disk_sector_t sector;               /* Directory's inode sector. */
+	struct list_elem elem;              /* Element in dir_indexes. */
+	int users;                          /* Operations holding or waiting
+	                                       for LOCK. */
+	bool dropped;                       /* No longer in dir_indexes. */
+
+	struct lock lock;                   /* Protects the directory and the
+	                                       members below. */
+	bool built;                         /* NAMES and FREE_SLOTS are valid. */
+	struct hash names;                  /* Entries in use, by name. */
+	struct list free_slots;             /* Offsets of free entries. */
+};
+
+/* An entry in use, in a dir_index. */
+struct dir_index_entry {
+	struct hash_elem elem;              /* Element in dir_index's names. */
+	off_t ofs;                          /* Byte offset of the entry. */
+	disk_sector_t inode_sector;         /* Sector number of header. */
+	char name[NAME_MAX + 1];            /* Null terminated file name. */
+};
+
+/* The offset of a free entry, in a dir_index. */
+struct dir_free_slot {
+	struct list_elem elem;              /* Element in dir_index's free_slots. */
+	off_t ofs;                          /* Byte offset of the entry. */
+};
+
+/* Indexes of recently used directories, most recent first.  They
+ * outlive the directory's inode, which is closed after every
+ * operation on it, and are dropped when their directory is deleted
+ * or recreated.  Indexes in use are never replaced, so there may be
+ * more than DIR_INDEX_MAX for a while.  DIR_INDEX_LOCK protects the
+ * list and the USERS and DROPPED members; each directory's own lock
+ * is only taken once the index is found. */
+#define DIR_INDEX_MAX 8
+static struct list dir_indexes;
+static size_t dir_index_cnt;
+static struct lock dir_index_lock;
+
+/* Statistics. */
+static long long lookup_cnt;            /* # of name lookups. */
+static long long index_build_cnt;       /* # of indexes built. */
+static long long index_read_cnt;        /* # of entries read to build them. */
+
+static void dir_index_drop (disk_sector_t sector);
+
+/* Initializes the directory module. */
+void
+dir_init (void) {
+	list_init (&dir_indexes);
+	dir_index_cnt = 0;
+	lock_init (&dir_index_lock);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
  * given SECTOR.  Returns true if successful, false on failure. */
 bool
 dir_create (disk_sector_t sector, size_t entry_cnt) {
+	dir_index_drop (sector);
+	dentry_forget_dir (sector);
 	return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
 }
 
@@ -71,13 +136,203 @@ dir_get_inode (struct dir *dir) {
 	return dir->inode;
 }
 
+static uint64_t
+dir_index_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_string (hash_entry (e, struct dir_index_entry, elem)->name);
+}
+
+static bool
+dir_index_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return strcmp (hash_entry (a, struct dir_index_entry, elem)->name,
+			hash_entry (b, struct dir_index_entry, elem)->name) < 0;
+}
+
+static void
+dir_index_entry_free (struct hash_elem *e, void *aux UNUSED) {
+	free (hash_entry (e, struct dir_index_entry, elem));
+}
+
+/* Throws away the entries recorded in INDEX, so that the next
+ * operation reads the directory again. */
+static void
+dir_index_clear (struct dir_index *index) {
+	if (!index->built)
+		return;
+	hash_destroy (&index->names, dir_index_entry_free);
+	while (!list_empty (&index->free_slots))
+		free (list_entry (list_pop_front (&index->free_slots),
+					struct dir_free_slot, elem));
+	index->built = false;
+}
+
+/* Frees INDEX, which is no longer in dir_indexes. */
+static void
+dir_index_destroy (struct dir_index *index) {
+	dir_index_clear (index);
+	free (index);
+}
+
+/* Records that the entry at OFS of INDEX is free.
+ * Returns false if out of memory. */
+static bool
+dir_index_add_free (struct dir_index *index, off_t ofs) {
+	struct dir_free_slot *slot = malloc (sizeof *slot);
+	if (slot == NULL)
+		return false;
+	slot->ofs = ofs;
+	list_push_back (&index->free_slots, &slot->elem);
+	return true;
+}
+
+/* Records entry E, stored at OFS, in INDEX.
+ * Returns false if out of memory. */
+static bool
+dir_index_add (struct dir_index *index, const struct dir_entry *e,
+		off_t ofs) {
+	struct dir_index_entry *ie = malloc (sizeof *ie);
+	if (ie == NULL)
+		return false;
+	ie->ofs = ofs;
+	ie->inode_sector = e->inode_sector;
+	strlcpy (ie->name, e->name, sizeof ie->name);
+	hash_insert (&index->names, &ie->elem);
+	return true;
+}
+
+/* Returns the entry named NAME in INDEX, or a null pointer.  No entry
+ * has a name longer than NAME_MAX, and such a NAME must not be cut
+ * down to match one that does. */
+static struct dir_index_entry *
+dir_index_find (struct dir_index *index, const char *name) {
+	struct dir_index_entry key;
+	struct hash_elem *e;
+
+	if (strlen (name) > NAME_MAX)
+		return NULL;
+	strlcpy (key.name, name, sizeof key.name);
+	e = hash_find (&index->names, &key.elem);
+	return e != NULL ? hash_entry (e, struct dir_index_entry, elem) : NULL;
+}
+
+/* Records the entries of DIR in INDEX.  Leaves INDEX unbuilt if out
+ * of memory.  Must be called with INDEX's lock held. */
+static void
+dir_index_build (struct dir_index *index, const struct dir *dir) {
+	struct dir_entry e;
+	off_t ofs;
+
+	list_init (&index->free_slots);
+	if (!hash_init (&index->names, dir_index_hash, dir_index_less, NULL))
+		return;
+	index->built = true;
+	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+			ofs += sizeof e) {
+		if (!(e.in_use ? dir_index_add (index, &e, ofs)
+					: dir_index_add_free (index, ofs))) {
+			dir_index_clear (index);
+			return;
+		}
+		index_read_cnt++;
+	}
+	index_build_cnt++;
+}
+
+/* Finds or makes the index of DIR, acquires its lock and builds it if
+ * needed.  Returns a null pointer if out of memory.  The caller must
+ * give it back with dir_index_release(). */
+static struct dir_index *
+dir_index_acquire (const struct dir *dir) {
+	disk_sector_t sector = inode_get_inumber (dir->inode);
+	struct dir_index *index = NULL;
+	struct list_elem *el;
+
+	lock_acquire (&dir_index_lock);
+	for (el = list_begin (&dir_indexes); el != list_end (&dir_indexes);
+			el = list_next (el))
+		if (list_entry (el, struct dir_index, elem)->sector == sector) {
+			index = list_entry (el, struct dir_index, elem);
+			list_remove (el);
+			break;
+		}
+	if (index == NULL) {
+		index = malloc (sizeof *index);
+		if (index == NULL) {
+			lock_release (&dir_index_lock);
+			return NULL;
+		}
+		index->sector = sector;
+		index->users = 0;
+		index->dropped = false;
+		lock_init (&index->lock);
+		index->built = false;
+		dir_index_cnt++;
+	}
+	list_push_front (&dir_indexes, &index->elem);
+	index->users++;
+	lock_release (&dir_index_lock);
+
+	lock_acquire (&index->lock);
+	if (!index->built)
+		dir_index_build (index, dir);
+	return index;
+}
+
+/* Releases INDEX, acquired with dir_index_acquire(), and replaces
+ * unused indexes beyond DIR_INDEX_MAX. */
+static void
+dir_index_release (struct dir_index *index) {
+	struct list_elem *el;
+
+	lock_release (&index->lock);
+
+	lock_acquire (&dir_index_lock);
+	if (--index->users == 0 && index->dropped)
+		dir_index_destroy (index);
+	for (el = list_rbegin (&dir_indexes);
+			dir_index_cnt > DIR_INDEX_MAX && el != list_rend (&dir_indexes);) {
+		struct dir_index *victim = list_entry (el, struct dir_index, elem);
+		el = list_prev (el);
+		if (victim->users == 0) {
+			list_remove (&victim->elem);
+			dir_index_destroy (victim);
+			dir_index_cnt--;
+		}
+	}
+	lock_release (&dir_index_lock);
+}
+
+/* Forgets the index of the directory in SECTOR, if there is one. */
+static void
+dir_index_drop (disk_sector_t sector) {
+	struct list_elem *el;
+
+	lock_acquire (&dir_index_lock);
+	for (el = list_begin (&dir_indexes); el != list_end (&dir_indexes);
+			el = list_next (el)) {
+		struct dir_index *index = list_entry (el, struct dir_index, elem);
+		if (index->sector == sector) {
+			list_remove (el);
+			dir_index_cnt--;
+			if (index->users == 0)
+				dir_index_destroy (index);
+			else
+				index->dropped = true;
+			break;
+		}
+	}
+	lock_release (&dir_index_lock);
+}
+
 /* Searches DIR for a file with the given NAME.
  * If successful, returns true, sets *EP to the directory entry
  * if EP is non-null, and sets *OFSP to the byte offset of the
  * directory entry if OFSP is non-null.
- * otherwise, returns false and ignores EP and OFSP. */
+ * otherwise, returns false and ignores EP and OFSP.
+ * Uses INDEX, DIR's index, if it is built, and reads the directory
+ * otherwise.  Must be called with INDEX's lock held. */
 static bool
-lookup (const struct dir *dir, const char *name,
+lookup (const struct dir *dir, struct dir_index *index, const char *name,
 		struct dir_entry *ep, off_t *ofsp) {
 	struct dir_entry e;
 	size_t ofs;
@@ -85,6 +340,21 @@ lookup (const struct dir *dir, const char *name,
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	lookup_cnt++;
+	if (index->built) {
+		struct dir_index_entry *ie = dir_index_find (index, name);
+		if (ie == NULL)
+			return false;
+		if (ep != NULL) {
+			ep->inode_sector = ie->inode_sector;
+			strlcpy (ep->name, ie->name, sizeof ep->name);
+			ep->in_use = true;
+		}
+		if (ofsp != NULL)
+			*ofsp = ie->ofs;
+		return true;
+	}
+
 	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 			ofs += sizeof e)
 		if (e.in_use && !strcmp (name, e.name)) {
@@ -104,12 +374,29 @@ lookup (const struct dir *dir, const char *name,
 bool
 dir_lookup (const struct dir *dir, const char *name,
 		struct inode **inode) {
+	disk_sector_t parent = inode_get_inumber (dir->inode);
+	struct dir_index *index;
 	struct dir_entry e;
+	bool found, cached;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
-	if (lookup (dir, name, &e, NULL))
+	*inode = dentry_open (parent, name, &cached);
+	if (cached)
+		return *inode != NULL;
+
+	index = dir_index_acquire (dir);
+	if (index == NULL)
+		return false;
+	found = lookup (dir, index, name, &e, NULL);
+	if (found)
+		dentry_set (parent, name, e.inode_sector);
+	else
+		dentry_set_negative (parent, name);
+	dir_index_release (index);
+
+	if (found)
 		*inode = inode_open (e.inode_sector);
 	else
 		*inode = NULL;
@@ -125,6 +412,8 @@ dir_lookup (const struct dir *dir, const char *name,
  * error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
+	struct dir_index *index;
+	struct dir_free_slot *slot = NULL;
 	struct dir_entry e;
 	off_t ofs;
 	bool success = false;
@@ -136,8 +425,12 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	if (*name == '\0' || strlen (name) > NAME_MAX)
 		return false;
 
+	index = dir_index_acquire (dir);
+	if (index == NULL)
+		return false;
+
 	/* Check that NAME is not in use. */
-	if (lookup (dir, name, NULL, NULL))
+	if (lookup (dir, index, name, NULL, NULL))
 		goto done;
 
 	/* Set OFS to offset of free slot.
@@ -147,10 +440,18 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	 * inode_read_at() will only return a short read at end of file.
 	 * Otherwise, we'd need to verify that we didn't get a short
 	 * read due to something intermittent such as low memory. */
-	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-			ofs += sizeof e)
-		if (!e.in_use)
-			break;
+	if (index->built) {
+		if (!list_empty (&index->free_slots)) {
+			slot = list_entry (list_pop_front (&index->free_slots),
+					struct dir_free_slot, elem);
+			ofs = slot->ofs;
+		} else
+			ofs = inode_length (dir->inode);
+	} else
+		for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+				ofs += sizeof e)
+			if (!e.in_use)
+				break;
 
 	/* Write slot. */
 	e.in_use = true;
@@ -158,7 +459,21 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	e.inode_sector = inode_sector;
 	success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
+	/* Keep the index in step, or forget it if that fails. */
+	if (index->built) {
+		if (!success && slot != NULL) {
+			list_push_front (&index->free_slots, &slot->elem);
+			slot = NULL;
+		}
+		if (success && !dir_index_add (index, &e, ofs))
+			dir_index_clear (index);
+		free (slot);
+	}
+	if (success)
+		dentry_set (inode_get_inumber (dir->inode), name, inode_sector);
+
 done:
+	dir_index_release (index);
 	return success;
 }
 
@@ -167,6 +482,7 @@ done:
  * which occurs only if there is no file with the given NAME. */
 bool
 dir_remove (struct dir *dir, const char *name) {
+	struct dir_index *index;
 	struct dir_entry e;
 	struct inode *inode = NULL;
 	bool success = false;
@@ -175,8 +491,12 @@ dir_remove (struct dir *dir, const char *name) {
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	index = dir_index_acquire (dir);
+	if (index == NULL)
+		return false;
+
 	/* Find directory entry. */
-	if (!lookup (dir, name, &e, &ofs))
+	if (!lookup (dir, index, name, &e, &ofs))
 		goto done;
 
 	/* Open inode. */
@@ -189,11 +509,25 @@ dir_remove (struct dir *dir, const char *name) {
 	if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
 		goto done;
 
+	/* Keep the index in step, or forget it if that fails. */
+	if (index->built) {
+		struct dir_index_entry *ie = dir_index_find (index, name);
+		hash_delete (&index->names, &ie->elem);
+		free (ie);
+		if (!dir_index_add_free (index, ofs))
+			dir_index_clear (index);
+	}
+
+	dentry_set_negative (inode_get_inumber (dir->inode), name);
+
 	/* Remove inode. */
 	inode_remove (inode);
 	success = true;
 
 done:
+	dir_index_release (index);
+	if (success)
+		dir_index_drop (e.inode_sector);
 	inode_close (inode);
 	return success;
 }
@@ -214,3 +548,10 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1]) {
 	}
 	return false;
 }
+
+/* Prints directory statistics. */
+void
+dir_print_stats (void) {
+	printf ("Directories: %lld lookups, %lld indexes built from %lld entries\n",
+			lookup_cnt, index_build_cnt, index_read_cnt);
+}
@@ -1,4 +1,5 @@
 #include "filesys/fat.h"
+#include "filesys/buffer_cache.h"
 #include "devices/disk.h"
 #include "filesys/filesys.h"
 #include "threads/malloc.h"
@@ -41,7 +42,7 @@ fat_init (void) {
 	unsigned int *bounce = malloc (DISK_SECTOR_SIZE);
 	if (bounce == NULL)
 		PANIC ("FAT init failed");
-	disk_read (filesys_disk, FAT_BOOT_SECTOR, bounce);
+	buffer_cache_read (FAT_BOOT_SECTOR, bounce);
 	memcpy (&fat_fs->bs, bounce, sizeof (fat_fs->bs));
 	free (bounce);
 
@@ -65,14 +66,14 @@ fat_open (void) {
 	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
 		bytes_left = fat_size_in_bytes - bytes_read;
 		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i,
+			buffer_cache_read (fat_fs->bs.fat_start + i,
 			           buffer + bytes_read);
 			bytes_read += DISK_SECTOR_SIZE;
 		} else {
 			uint8_t *bounce = malloc (DISK_SECTOR_SIZE);
 			if (bounce == NULL)
 				PANIC ("FAT load failed");
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i, bounce);
+			buffer_cache_read (fat_fs->bs.fat_start + i, bounce);
 			memcpy (buffer + bytes_read, bounce, bytes_left);
 			bytes_read += bytes_left;
 			free (bounce);
@@ -87,7 +88,7 @@ fat_close (void) {
 	if (bounce == NULL)
 		PANIC ("FAT close failed");
 	memcpy (bounce, &fat_fs->bs, sizeof (fat_fs->bs));
-	disk_write (filesys_disk, FAT_BOOT_SECTOR, bounce);
+	buffer_cache_write (FAT_BOOT_SECTOR, bounce);
 	free (bounce);
 
 	// Write FAT directly to the disk
@@ -98,7 +99,7 @@ fat_close (void) {
 	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
 		bytes_left = fat_size_in_bytes - bytes_wrote;
 		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i,
+			buffer_cache_write (fat_fs->bs.fat_start + i,
 			            buffer + bytes_wrote);
 			bytes_wrote += DISK_SECTOR_SIZE;
 		} else {
@@ -106,7 +107,7 @@ fat_close (void) {
 			if (bounce == NULL)
 				PANIC ("FAT close failed");
 			memcpy (bounce, buffer + bytes_wrote, bytes_left);
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i, bounce);
+			buffer_cache_write (fat_fs->bs.fat_start + i, bounce);
 			bytes_wrote += bytes_left;
 			free (bounce);
 		}
@@ -131,7 +132,7 @@ fat_create (void) {
 	uint8_t *buf = calloc (1, DISK_SECTOR_SIZE);
 	if (buf == NULL)
 		PANIC ("FAT create failed due to OOM");
-	disk_write (filesys_disk, cluster_to_sector (ROOT_DIR_CLUSTER), buf);
+	buffer_cache_write (cluster_to_sector (ROOT_DIR_CLUSTER), buf);
 	free (buf);
 }
 
@@ -2,11 +2,16 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/buffer_cache.h"
+#include "filesys/dentry.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
 #include "devices/disk.h"
+#ifdef VM
+#include "filesys/page_cache.h"
+#endif
 
 /* The disk that contains the file system. */
 struct disk *filesys_disk;
@@ -21,7 +26,10 @@ filesys_init (bool format) {
 	if (filesys_disk == NULL)
 		PANIC ("hd0:1 (hdb) not present, file system initialization failed");
 
+	buffer_cache_init ();
 	inode_init ();
+	dir_init ();
+	dentry_init ();
 
 #ifdef EFILESYS
 	fat_init ();
@@ -45,12 +53,19 @@ filesys_init (bool format) {
  * to disk. */
 void
 filesys_done (void) {
+#ifdef VM
+	/* File data first: it goes to disk through the buffer cache's
+	 * sectors, which are flushed last. */
+	page_cache_flush ();
+#endif
+	inode_flush ();
 	/* Original FS */
 #ifdef EFILESYS
 	fat_close ();
 #else
 	free_map_close ();
 #endif
+	buffer_cache_done ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -79,9 +94,17 @@ filesys_create (const char *name, off_t initial_size) {
  * or if an internal memory allocation fails. */
 struct file *
 filesys_open (const char *name) {
-	struct dir *dir = dir_open_root ();
-	struct inode *inode = NULL;
+	struct dir *dir;
+	struct inode *inode;
+	bool cached;
+
+	/* A cached name needs no directory at all. */
+	inode = dentry_open (ROOT_DIR_SECTOR, name, &cached);
+	if (cached)
+		return file_open (inode);
 
+	dir = dir_open_root ();
+	inode = NULL;
 	if (dir != NULL)
 		dir_lookup (dir, name, &inode);
 	dir_close (dir);
@@ -1,13 +1,40 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
+#include <stdio.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
+static struct lock sync_lock;        /* Serializes syncs with closing it. */
 static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
 
+/* Allocations and releases only change the in-memory free map and mark
+ * the sectors of the free map file they touched in dirty_map.
+ * free_map_sync() writes those sectors, and nothing else, at the next
+ * sync point: the buffer cache's periodic flush, or closing the free
+ * map. */
+#define BITS_PER_SECTOR (DISK_SECTOR_SIZE * 8)
+static struct bitmap *dirty_map;     /* One bit per free map file sector. */
+
+/* Free sectors, and how many of them are promised to files for data
+ * whose allocation is delayed until writeback.  Ordinary allocations
+ * leave the reserved ones alone. */
+static size_t free_cnt;
+static size_t reserved_cnt;
+
+/* Protects the maps and counts above.  Allocation happens during
+ * writeback as well, outside the file system's callers. */
+static struct lock free_map_lock;
+
+/* Statistics. */
+static long long change_cnt;         /* # of allocations and releases. */
+static long long sync_write_cnt;     /* # of free map sectors written. */
+static size_t mount_free_cnt;        /* Free sectors when the map was opened. */
+
 /* Initializes the free map. */
 void
 free_map_init (void) {
@@ -16,6 +43,25 @@ free_map_init (void) {
 		PANIC ("bitmap creation failed--disk is too large");
 	bitmap_mark (free_map, FREE_MAP_SECTOR);
 	bitmap_mark (free_map, ROOT_DIR_SECTOR);
+
+	dirty_map = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+				DISK_SECTOR_SIZE));
+	if (dirty_map == NULL)
+		PANIC ("bitmap creation failed--disk is too large");
+	free_cnt = bitmap_count (free_map, 0, bitmap_size (free_map), false);
+	reserved_cnt = 0;
+	lock_init (&free_map_lock);
+	lock_init (&sync_lock);
+}
+
+/* Notes that the bits for CNT sectors starting at SECTOR changed. */
+static void
+mark_dirty (disk_sector_t sector, size_t cnt) {
+	size_t first = sector / BITS_PER_SECTOR;
+	size_t last = (sector + cnt - 1) / BITS_PER_SECTOR;
+
+	bitmap_set_multiple (dirty_map, first, last - first + 1, true);
+	change_cnt++;
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -24,24 +70,130 @@ free_map_init (void) {
  * available. */
 bool
 free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
-	disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-	if (sector != BITMAP_ERROR
-			&& free_map_file != NULL
-			&& !bitmap_write (free_map, free_map_file)) {
-		bitmap_set_multiple (free_map, sector, cnt, false);
-		sector = BITMAP_ERROR;
-	}
-	if (sector != BITMAP_ERROR)
+	return free_map_allocate_reserved (cnt, 0, sectorp);
+}
+
+/* Like free_map_allocate(), but RESERVED of the CNT sectors come out
+ * of sectors the caller set aside with free_map_reserve(), which
+ * stay set aside if the allocation fails. */
+bool
+free_map_allocate_reserved (size_t cnt, size_t reserved,
+		disk_sector_t *sectorp) {
+	disk_sector_t sector = BITMAP_ERROR;
+
+	ASSERT (reserved <= cnt);
+
+	lock_acquire (&free_map_lock);
+	ASSERT (reserved <= reserved_cnt);
+	if (free_cnt - reserved_cnt >= cnt - reserved)
+		sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+	if (sector != BITMAP_ERROR) {
+		free_cnt -= cnt;
+		reserved_cnt -= reserved;
+		if (cnt > 0)
+			mark_dirty (sector, cnt);
 		*sectorp = sector;
+	}
+	lock_release (&free_map_lock);
 	return sector != BITMAP_ERROR;
 }
 
+/* Allocates the CNT sectors starting at SECTOR, if they are all free,
+ * RESERVED of them out of the caller's reservation as in
+ * free_map_allocate_reserved().  Returns true if successful. */
+bool
+free_map_allocate_at (disk_sector_t sector, size_t cnt, size_t reserved) {
+	bool success;
+
+	ASSERT (reserved <= cnt);
+
+	lock_acquire (&free_map_lock);
+	ASSERT (reserved <= reserved_cnt);
+	success = cnt > 0 && free_cnt - reserved_cnt >= cnt - reserved
+		&& sector + cnt <= bitmap_size (free_map)
+		&& bitmap_none (free_map, sector, cnt);
+	if (success) {
+		bitmap_set_multiple (free_map, sector, cnt, true);
+		free_cnt -= cnt;
+		reserved_cnt -= reserved;
+		mark_dirty (sector, cnt);
+	}
+	lock_release (&free_map_lock);
+	return success;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (disk_sector_t sector, size_t cnt) {
+	lock_acquire (&free_map_lock);
 	ASSERT (bitmap_all (free_map, sector, cnt));
 	bitmap_set_multiple (free_map, sector, cnt, false);
-	bitmap_write (free_map, free_map_file);
+	free_cnt += cnt;
+	if (cnt > 0)
+		mark_dirty (sector, cnt);
+	lock_release (&free_map_lock);
+}
+
+/* Sets aside CNT free sectors for data that will be allocated later,
+ * so that writing it back cannot run out of space.
+ * Returns false if not enough sectors are free. */
+bool
+free_map_reserve (size_t cnt) {
+	bool success;
+
+	lock_acquire (&free_map_lock);
+	success = free_cnt - reserved_cnt >= cnt;
+	if (success)
+		reserved_cnt += cnt;
+	lock_release (&free_map_lock);
+	return success;
+}
+
+/* Returns CNT sectors set aside by free_map_reserve(). */
+void
+free_map_unreserve (size_t cnt) {
+	lock_acquire (&free_map_lock);
+	ASSERT (reserved_cnt >= cnt);
+	reserved_cnt -= cnt;
+	lock_release (&free_map_lock);
+}
+
+/* Writes the free map sectors changed since the last sync, each run
+ * of adjacent ones in a single write.  Does nothing until the free
+ * map is open. */
+void
+free_map_sync (void) {
+	size_t start = 0;
+
+	if (free_map_file == NULL)
+		return;
+	/* Closing the free map waits for a sync in progress. */
+	lock_acquire (&sync_lock);
+	while (free_map_file != NULL) {
+		size_t end;
+
+		/* Writing the file may evict pages whose writeback allocates
+		 * sectors, so the lock is only held while picking the next run.
+		 * A change made meanwhile marks its sector dirty again. */
+		lock_acquire (&free_map_lock);
+		start = bitmap_scan (dirty_map, start, 1, true);
+		if (start == BITMAP_ERROR) {
+			lock_release (&free_map_lock);
+			break;
+		}
+		end = start + 1;
+		while (end < bitmap_size (dirty_map) && bitmap_test (dirty_map, end))
+			end++;
+		bitmap_set_multiple (dirty_map, start, end - start, false);
+		lock_release (&free_map_lock);
+
+		if (!bitmap_write_range (free_map, free_map_file,
+					start * DISK_SECTOR_SIZE, (end - start) * DISK_SECTOR_SIZE))
+			PANIC ("can't write free map");
+		sync_write_cnt += end - start;
+		start = end;
+	}
+	lock_release (&sync_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -52,12 +204,18 @@ free_map_open (void) {
 		PANIC ("can't open free map");
 	if (!bitmap_read (free_map, free_map_file))
 		PANIC ("can't read free map");
+	free_cnt = bitmap_count (free_map, 0, bitmap_size (free_map), false);
+	mount_free_cnt = free_cnt;
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) {
+	free_map_sync ();
+	lock_acquire (&sync_lock);
 	file_close (free_map_file);
+	free_map_file = NULL;
+	lock_release (&sync_lock);
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -74,4 +232,14 @@ free_map_create (void) {
 		PANIC ("can't open free map");
 	if (!bitmap_write (free_map, free_map_file))
 		PANIC ("can't write free map");
+	bitmap_set_all (dirty_map, false);
+}
+
+/* Prints free map statistics. */
+void
+free_map_print_stats (void) {
+	printf ("Free map: %lld changes, %lld sectors written\n",
+			change_cnt, sync_write_cnt);
+	printf ("Free map: %zu sectors free, %zu when mounted\n",
+			free_cnt, mount_free_cnt);
 }
@@ -1,22 +1,52 @@
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
+#include <stdio.h>
 #include <string.h>
+#include "filesys/buffer_cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#ifdef VM
+#include "filesys/page_cache.h"
+#endif
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* A run of COUNT sectors of a file, starting at file sector LOGICAL,
+ * stored in consecutive disk sectors starting at START. */
+struct extent {
+	uint32_t logical;                   /* First sector within the file. */
+	disk_sector_t start;                /* First disk sector. */
+	uint32_t count;                     /* Number of sectors. */
+};
+
+/* Extents kept in the inode itself and in its overflow block. */
+#define INLINE_EXTENTS 41
+#define OVERFLOW_EXTENTS 42
+#define MAX_EXTENTS (INLINE_EXTENTS + OVERFLOW_EXTENTS)
+
 /* On-disk inode.
- * Must be exactly DISK_SECTOR_SIZE bytes long. */
+ * Must be exactly DISK_SECTOR_SIZE bytes long.
+ * File sectors not covered by an extent are holes and read as zeros. */
 struct inode_disk {
-	disk_sector_t start;                /* First data sector. */
 	off_t length;                       /* File size in bytes. */
 	unsigned magic;                     /* Magic number. */
-	uint32_t unused[125];               /* Not used. */
+	uint32_t extent_cnt;                /* Extents in use, overflow included. */
+	disk_sector_t overflow;             /* Overflow extent block, or 0. */
+	struct extent extents[INLINE_EXTENTS]; /* First extents, by file sector. */
+	uint32_t unused[1];                 /* Not used. */
+};
+
+/* Overflow extent block: the extents after the first INLINE_EXTENTS.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct extent_block {
+	struct extent extents[OVERFLOW_EXTENTS];
+	uint32_t unused[2];                 /* Not used. */
 };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -26,72 +56,386 @@ bytes_to_sectors (off_t size) {
 	return DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
 }
 
-/* In-memory inode. */
+/* In-memory inode.
+ * A write past the end of file only extends LENGTH and reserves free
+ * sectors for it; disk sectors are allocated when the data is written
+ * back, so appends that are written back together get one run. */
 struct inode {
-	struct list_elem elem;              /* Element in inode list. */
+	struct hash_elem elem;              /* Element in open inode table. */
+	struct list_elem flush_elem;        /* Element in inode_flush()'s list. */
 	disk_sector_t sector;               /* Sector number of disk location. */
 	int open_cnt;                       /* Number of openers. */
+	bool busy;                          /* Being read in or torn down. */
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+	struct rwlock lock;                 /* Protects the members below: held
+	                                       for reading to map offsets and
+	                                       for writing to change them. */
+	bool dirty;                         /* DATA or EXTENTS not on disk yet. */
+	size_t reserved;                    /* Free sectors reserved for holes. */
+	off_t write_end;                    /* End of the data written so far or
+	                                       being written: past DATA.length
+	                                       while a write that extends the
+	                                       file is copying its data in. */
 	struct inode_disk data;             /* Inode content. */
+	struct extent extents[MAX_EXTENTS]; /* All extents, by file sector. */
+};
+
+/* Statistics, protected by stat_lock. */
+static struct lock stat_lock;
+static long long alloc_sector_cnt;      /* # of data sectors allocated. */
+static long long alloc_run_cnt;         /* # of runs they were allocated in. */
+static long long delayed_sector_cnt;    /* # of them allocated at writeback. */
+static long long extent_new_cnt;        /* # of runs that began a new extent. */
+static long long lookup_cnt;            /* # of offset to sector lookups. */
+static long long lookup_hit_cnt;        /* # of them answered by the hint. */
+static long long open_call_cnt;         /* # of inode_open() calls. */
+static long long open_hit_cnt;          /* # of them that found it open. */
+static int io_cnt;                      /* # of reads and writes under way. */
+static int io_peak_cnt;                 /* Most of them ever under way. */
+
+/* Returns the index of the first extent of INODE that ends after
+ * file sector IDX. */
+static size_t
+extent_find (const struct inode *inode, uint32_t idx) {
+	size_t lo = 0, hi = inode->data.extent_cnt;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		const struct extent *e = &inode->extents[mid];
+		if (e->logical + e->count <= idx)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* Returns true if extent I of INODE covers file sector IDX. */
+static bool
+extent_covers (const struct inode *inode, size_t i, uint32_t idx) {
+	return i < inode->data.extent_cnt && inode->extents[i].logical <= idx
+		&& idx - inode->extents[i].logical < inode->extents[i].count;
+}
+
+/* Where a caller's lookups in the extent table are: the extent of its
+ * last lookup, to start the next one from, and how well that works. */
+struct extent_cursor {
+	size_t hint;                        /* Extent of the last lookup. */
+	long long lookup_cnt;               /* # of lookups. */
+	long long hit_cnt;                  /* # of them answered by HINT. */
 };
 
 /* Returns the disk sector that contains byte offset POS within
  * INODE.
  * Returns -1 if INODE does not contain data for a byte at offset
- * POS. */
+ * POS, or the byte lies in a hole.
+ * Sequential access stays within one extent or moves on to the next,
+ * so those two are tried before searching, starting from the extent
+ * of the caller's last lookup in CURSOR, which is updated. */
 static disk_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) {
+byte_to_sector (const struct inode *inode, off_t pos,
+		struct extent_cursor *cursor) {
 	ASSERT (inode != NULL);
-	if (pos < inode->data.length)
-		return inode->data.start + pos / DISK_SECTOR_SIZE;
-	else
-		return -1;
+	if ((size_t) pos / DISK_SECTOR_SIZE < bytes_to_sectors (inode->write_end)) {
+		uint32_t idx = pos / DISK_SECTOR_SIZE;
+		size_t i = cursor->hint;
+
+		cursor->lookup_cnt++;
+		if (extent_covers (inode, i, idx) || extent_covers (inode, ++i, idx))
+			cursor->hit_cnt++;
+		else
+			i = extent_find (inode, idx);
+		if (extent_covers (inode, i, idx)) {
+			cursor->hint = i;
+			return inode->extents[i].start + (idx - inode->extents[i].logical);
+		}
+	}
+	return -1;
 }
 
-/* List of open inodes, so that opening a single inode twice
- * returns the same `struct inode'. */
-static struct list open_inodes;
+/* Adds the lookups made through CURSOR to the statistics. */
+static void
+extent_cursor_done (const struct extent_cursor *cursor) {
+	lock_acquire (&stat_lock);
+	lookup_cnt += cursor->lookup_cnt;
+	lookup_hit_cnt += cursor->hit_cnt;
+	lock_release (&stat_lock);
+}
+
+/* Returns the number of holes among the CNT file sectors of INODE
+ * starting at FIRST. */
+static size_t
+inode_holes (const struct inode *inode, uint32_t first, uint32_t cnt) {
+	uint32_t end = first + cnt;
+	size_t holes = cnt;
+
+	for (size_t i = extent_find (inode, first);
+			i < inode->data.extent_cnt && inode->extents[i].logical < end; i++) {
+		const struct extent *e = &inode->extents[i];
+		uint32_t lo = e->logical > first ? e->logical : first;
+		uint32_t hi = e->logical + e->count < end ? e->logical + e->count : end;
+		holes -= hi - lo;
+	}
+	return holes;
+}
+
+/* Records that the COUNT file sectors from LOGICAL, a hole so far, are
+ * stored from disk sector START, joining the neighbouring extents if
+ * they continue on disk.  Returns false if that would take more than
+ * LIMIT extents. */
+static bool
+extent_add (struct inode *inode, uint32_t logical, disk_sector_t start,
+		uint32_t count, size_t limit) {
+	size_t cnt = inode->data.extent_cnt;
+	size_t i = extent_find (inode, logical);
+	struct extent *prev = i > 0 ? &inode->extents[i - 1] : NULL;
+	struct extent *next = i < cnt ? &inode->extents[i] : NULL;
+	bool join_prev = prev != NULL && prev->logical + prev->count == logical
+		&& prev->start + prev->count == start;
+	bool join_next = next != NULL && logical + count == next->logical
+		&& start + count == next->start;
+
+	if (join_prev && join_next) {
+		prev->count += count + next->count;
+		memmove (next, next + 1, (cnt - i - 1) * sizeof *next);
+		cnt--;
+	} else if (join_prev)
+		prev->count += count;
+	else if (join_next) {
+		next->logical = logical;
+		next->start = start;
+		next->count += count;
+	} else {
+		if (cnt >= limit)
+			return false;
+		memmove (&inode->extents[i + 1], &inode->extents[i],
+				(cnt - i) * sizeof *inode->extents);
+		inode->extents[i].logical = logical;
+		inode->extents[i].start = start;
+		inode->extents[i].count = count;
+		cnt++;
+		lock_acquire (&stat_lock);
+		extent_new_cnt++;
+		lock_release (&stat_lock);
+	}
+	inode->data.extent_cnt = cnt;
+	inode->dirty = true;
+	return true;
+}
+
+/* Gives the holes among the CNT file sectors of INODE starting at
+ * FIRST disk sectors, in as few runs as possible.  Each run goes
+ * right after the disk sectors of the file data before it if they
+ * are free.  Sectors reserved for INODE are used up first.  New
+ * sectors are zeroed if ZERO, on disk right away, so that the extents
+ * that map them never reach the disk ahead of the zeros.  At most
+ * LIMIT extents are used.  Must be called with INODE's lock held for
+ * writing.
+ * Returns false if the disk is full or LIMIT is reached. */
+static bool
+inode_allocate (struct inode *inode, uint32_t first, uint32_t cnt,
+		bool zero, size_t limit) {
+	static char zeros[DISK_SECTOR_SIZE];
+	uint32_t idx = first, end = first + cnt;
+
+	while (idx < end) {
+		size_t i = extent_find (inode, idx);
+		struct extent *next = i < inode->data.extent_cnt
+			? &inode->extents[i] : NULL;
+
+		/* Skip what is mapped already. */
+		if (next != NULL && next->logical <= idx) {
+			idx = next->logical + next->count;
+			continue;
+		}
+
+		uint32_t run = (next != NULL && next->logical < end
+				? next->logical : end) - idx;
+		size_t reserved;
+
+		/* Place the run after the data before it on disk, or in the
+		 * first free run that fits, or in ever smaller pieces. */
+		disk_sector_t start;
+		bool ok = false;
+		if (i > 0) {
+			struct extent *prev = &inode->extents[i - 1];
+			start = prev->start + (idx - prev->logical);
+			reserved = run < inode->reserved ? run : inode->reserved;
+			ok = free_map_allocate_at (start, run, reserved);
+		}
+		while (!ok && run > 0) {
+			reserved = run < inode->reserved ? run : inode->reserved;
+			ok = free_map_allocate_reserved (run, reserved, &start);
+			if (!ok)
+				run /= 2;
+		}
+		if (!ok)
+			return false;
+		if (!extent_add (inode, idx, start, run, limit)) {
+			free_map_release (start, run);
+			if (!free_map_reserve (reserved))
+				inode->reserved -= reserved;
+			return false;
+		}
+		inode->reserved -= reserved;
+
+		if (zero)
+			for (uint32_t j = 0; j < run; j++)
+				buffer_cache_write_through (start + j, zeros);
+		lock_acquire (&stat_lock);
+		alloc_sector_cnt += run;
+		alloc_run_cnt++;
+		if (!zero)
+			delayed_sector_cnt += run;
+		lock_release (&stat_lock);
+		idx += run;
+	}
+	return true;
+}
+
+/* Frees every data sector of INODE and its overflow block. */
+static void
+inode_release (struct inode *inode) {
+	for (size_t i = 0; i < inode->data.extent_cnt; i++)
+		free_map_release (inode->extents[i].start, inode->extents[i].count);
+	if (inode->data.overflow != 0)
+		free_map_release (inode->data.overflow, 1);
+	inode->data.extent_cnt = 0;
+	inode->data.overflow = 0;
+}
+
+/* Writes INODE's on-disk inode and, if its extents do not fit in it,
+ * its overflow block.  Returns false if the overflow block could not
+ * be allocated. */
+static bool
+inode_write_disk (struct inode *inode) {
+	size_t cnt = inode->data.extent_cnt;
+	size_t inline_cnt = cnt < INLINE_EXTENTS ? cnt : INLINE_EXTENTS;
+
+	memcpy (inode->data.extents, inode->extents,
+			inline_cnt * sizeof *inode->extents);
+	if (cnt > INLINE_EXTENTS) {
+		struct extent_block *block;
+
+		if (inode->data.overflow == 0
+				&& !free_map_allocate (1, &inode->data.overflow))
+			return false;
+		block = calloc (1, sizeof *block);
+		if (block == NULL)
+			return false;
+		memcpy (block->extents, inode->extents + INLINE_EXTENTS,
+				(cnt - INLINE_EXTENTS) * sizeof *block->extents);
+		buffer_cache_write (inode->data.overflow, block);
+		free (block);
+	}
+	buffer_cache_write (inode->sector, &inode->data);
+	inode->dirty = false;
+	return true;
+}
+
+/* Table of open inodes, so that opening a single inode twice
+ * returns the same `struct inode'.  It is split by sector into shards
+ * with a lock each, so opens and closes of different inodes rarely
+ * wait for each other.  No disk I/O happens under a shard lock: an
+ * inode being read in or torn down stays in the table marked busy,
+ * and whoever wants it waits on SETTLED. */
+#define OPEN_INODE_SHARDS 16
+
+struct open_inode_shard {
+	struct lock lock;                   /* Protects the members below and
+	                                       open_cnt and busy of its inodes. */
+	struct condition settled;           /* An inode stopped being busy. */
+	struct hash inodes;                 /* Open inodes, by sector. */
+};
+
+static struct open_inode_shard open_inodes[OPEN_INODE_SHARDS];
+
+static uint64_t
+open_inode_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+static bool
+open_inode_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct inode, elem)->sector
+		< hash_entry (b, struct inode, elem)->sector;
+}
+
+/* Returns the shard that holds the inode in SECTOR. */
+static struct open_inode_shard *
+open_inode_shard (disk_sector_t sector) {
+	return &open_inodes[sector % OPEN_INODE_SHARDS];
+}
+
+/* Returns the open inode in SECTOR, or a null pointer.  Must be
+ * called with SHARD's lock held. */
+static struct inode *
+open_inode_find (struct open_inode_shard *shard, disk_sector_t sector) {
+	struct inode key;
+	struct hash_elem *e;
+
+	key.sector = sector;
+	e = hash_find (&shard->inodes, &key.elem);
+	return e != NULL ? hash_entry (e, struct inode, elem) : NULL;
+}
+
+/* Takes busy INODE out of the open inode table and frees it. */
+static void
+open_inode_remove (struct inode *inode) {
+	struct open_inode_shard *shard = open_inode_shard (inode->sector);
+
+	lock_acquire (&shard->lock);
+	hash_delete (&shard->inodes, &inode->elem);
+	cond_broadcast (&shard->settled, &shard->lock);
+	lock_release (&shard->lock);
+	free (inode);
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) {
-	list_init (&open_inodes);
+	for (int i = 0; i < OPEN_INODE_SHARDS; i++) {
+		struct open_inode_shard *shard = &open_inodes[i];
+		lock_init (&shard->lock);
+		cond_init (&shard->settled);
+		if (!hash_init (&shard->inodes, open_inode_hash, open_inode_less, NULL))
+			PANIC ("open inode table creation failed");
+	}
+	lock_init (&stat_lock);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
  * writes the new inode to sector SECTOR on the file system
- * disk.
+ * disk.  The data is allocated and zeroed right away.
  * Returns true if successful.
  * Returns false if memory or disk allocation fails. */
 bool
 inode_create (disk_sector_t sector, off_t length) {
-	struct inode_disk *disk_inode = NULL;
+	struct inode *inode = NULL;
 	bool success = false;
 
 	ASSERT (length >= 0);
 
 	/* If this assertion fails, the inode structure is not exactly
 	 * one sector in size, and you should fix that. */
-	ASSERT (sizeof *disk_inode == DISK_SECTOR_SIZE);
-
-	disk_inode = calloc (1, sizeof *disk_inode);
-	if (disk_inode != NULL) {
-		size_t sectors = bytes_to_sectors (length);
-		disk_inode->length = length;
-		disk_inode->magic = INODE_MAGIC;
-		if (free_map_allocate (sectors, &disk_inode->start)) {
-			disk_write (filesys_disk, sector, disk_inode);
-			if (sectors > 0) {
-				static char zeros[DISK_SECTOR_SIZE];
-				size_t i;
-
-				for (i = 0; i < sectors; i++) 
-					disk_write (filesys_disk, disk_inode->start + i, zeros); 
-			}
-			success = true; 
-		} 
-		free (disk_inode);
+	ASSERT (sizeof (struct inode_disk) == DISK_SECTOR_SIZE);
+	ASSERT (sizeof (struct extent_block) == DISK_SECTOR_SIZE);
+
+	inode = calloc (1, sizeof *inode);
+	if (inode != NULL) {
+		inode->sector = sector;
+		inode->data.length = length;
+		inode->data.magic = INODE_MAGIC;
+		rwlock_init (&inode->lock);
+		if (inode_allocate (inode, 0, bytes_to_sectors (length), true,
+					MAX_EXTENTS)
+				&& inode_write_disk (inode))
+			success = true;
+		else
+			inode_release (inode);
+		free (inode);
 	}
 	return success;
 }
@@ -101,39 +445,83 @@ inode_create (disk_sector_t sector, off_t length) {
  * Returns a null pointer if memory allocation fails. */
 struct inode *
 inode_open (disk_sector_t sector) {
-	struct list_elem *e;
+	struct open_inode_shard *shard = open_inode_shard (sector);
 	struct inode *inode;
 
-	/* Check whether this inode is already open. */
-	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-			e = list_next (e)) {
-		inode = list_entry (e, struct inode, elem);
-		if (inode->sector == sector) {
-			inode_reopen (inode);
-			return inode; 
-		}
+	/* Check whether this inode is already open, waiting for it if it
+	 * is being read in or torn down. */
+	lock_acquire (&shard->lock);
+	while ((inode = open_inode_find (shard, sector)) != NULL && inode->busy)
+		cond_wait (&shard->settled, &shard->lock);
+	lock_acquire (&stat_lock);
+	open_call_cnt++;
+	if (inode != NULL)
+		open_hit_cnt++;
+	lock_release (&stat_lock);
+	if (inode != NULL) {
+		inode->open_cnt++;
+		lock_release (&shard->lock);
+		return inode;
 	}
 
 	/* Allocate memory. */
 	inode = malloc (sizeof *inode);
-	if (inode == NULL)
+	if (inode == NULL) {
+		lock_release (&shard->lock);
 		return NULL;
+	}
 
-	/* Initialize. */
-	list_push_front (&open_inodes, &inode->elem);
+	/* Initialize.  Until it is read in, the inode is busy. */
 	inode->sector = sector;
 	inode->open_cnt = 1;
+	inode->busy = true;
+	hash_insert (&shard->inodes, &inode->elem);
+	lock_release (&shard->lock);
+
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
-	disk_read (filesys_disk, inode->sector, &inode->data);
+	rwlock_init (&inode->lock);
+	inode->dirty = false;
+	buffer_cache_read (inode->sector, &inode->data);
+
+	size_t cnt = inode->data.extent_cnt;
+	memcpy (inode->extents, inode->data.extents,
+			(cnt < INLINE_EXTENTS ? cnt : INLINE_EXTENTS) * sizeof *inode->extents);
+	if (cnt > INLINE_EXTENTS) {
+		struct extent_block *block = malloc (sizeof *block);
+		if (block == NULL) {
+			open_inode_remove (inode);
+			return NULL;
+		}
+		buffer_cache_read (inode->data.overflow, block);
+		memcpy (inode->extents + INLINE_EXTENTS, block->extents,
+				(cnt - INLINE_EXTENTS) * sizeof *block->extents);
+		free (block);
+	}
+
+	/* Holes left by an earlier growth get their space back. */
+	inode->write_end = inode->data.length;
+	inode->reserved = inode_holes (inode, 0,
+			bytes_to_sectors (inode->data.length));
+	if (!free_map_reserve (inode->reserved))
+		inode->reserved = 0;
+
+	lock_acquire (&shard->lock);
+	inode->busy = false;
+	cond_broadcast (&shard->settled, &shard->lock);
+	lock_release (&shard->lock);
 	return inode;
 }
 
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode) {
-	if (inode != NULL)
+	if (inode != NULL) {
+		struct open_inode_shard *shard = open_inode_shard (inode->sector);
+		lock_acquire (&shard->lock);
 		inode->open_cnt++;
+		lock_release (&shard->lock);
+	}
 	return inode;
 }
 
@@ -152,19 +540,68 @@ inode_close (struct inode *inode) {
 	if (inode == NULL)
 		return;
 
-	/* Release resources if this was the last opener. */
-	if (--inode->open_cnt == 0) {
-		/* Remove from inode list and release lock. */
-		list_remove (&inode->elem);
+	/* Release resources if this was the last opener.  The inode stays
+	 * in the table, busy, until its data is written, so that opening it
+	 * again cannot read a stale disk inode. */
+	struct open_inode_shard *shard = open_inode_shard (inode->sector);
+	bool last;
+
+	lock_acquire (&shard->lock);
+	last = --inode->open_cnt == 0;
+	if (last)
+		inode->busy = true;
+	lock_release (&shard->lock);
+
+	if (last) {
+#ifdef VM
+		/* Cached pages of a removed file need not reach the disk. */
+		if (page_cache_enabled ())
+			page_cache_drop (inode, !inode->removed);
+#endif
 
 		/* Deallocate blocks if removed. */
 		if (inode->removed) {
 			free_map_release (inode->sector, 1);
-			free_map_release (inode->data.start,
-					bytes_to_sectors (inode->data.length)); 
+			inode_release (inode);
+		} else if (inode->dirty)
+			inode_write_disk (inode);
+		free_map_unreserve (inode->reserved);
+
+		open_inode_remove (inode);
+	}
+}
+
+/* Writes the dirty open inodes to disk, so that metadata of files
+ * still open, such as their length, is not lost at shutdown.  Each is
+ * held open meanwhile, and no disk I/O happens under a shard lock. */
+void
+inode_flush (void) {
+	struct list dirty;
+	struct hash_iterator i;
+
+	list_init (&dirty);
+	for (size_t s = 0; s < OPEN_INODE_SHARDS; s++) {
+		struct open_inode_shard *shard = &open_inodes[s];
+		lock_acquire (&shard->lock);
+		hash_first (&i, &shard->inodes);
+		while (hash_next (&i)) {
+			struct inode *inode = hash_entry (hash_cur (&i), struct inode, elem);
+			if (!inode->busy && inode->dirty && !inode->removed) {
+				inode->open_cnt++;
+				list_push_back (&dirty, &inode->flush_elem);
+			}
 		}
+		lock_release (&shard->lock);
+	}
 
-		free (inode); 
+	while (!list_empty (&dirty)) {
+		struct inode *inode = list_entry (list_pop_front (&dirty),
+				struct inode, flush_elem);
+		rwlock_acquire_write (&inode->lock);
+		if (inode->dirty)
+			inode_write_disk (inode);
+		rwlock_release_write (&inode->lock);
+		inode_close (inode);
 	}
 }
 
@@ -176,115 +613,286 @@ inode_remove (struct inode *inode) {
 	inode->removed = true;
 }
 
-/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
- * Returns the number of bytes actually read, which may be less
- * than SIZE if an error occurs or end of file is reached. */
-off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
-	uint8_t *buffer = buffer_;
-	off_t bytes_read = 0;
-	uint8_t *bounce = NULL;
+/* Copies SIZE bytes at OFFSET of INODE into or out of BUFFER sector
+ * by sector, up to the end of the file.  DIRECT bypasses the buffer
+ * cache for sectors it does not hold, and a direct write may go on to
+ * the end of the last sector, writing whole sectors that lie together
+ * on disk at once.  Any other write may go on to the end
+ * of the write being prepared, and extends the file as its data gets
+ * in.  Holes read as zeros; a write stops at one.  Returns the number
+ * of bytes copied. */
+static off_t
+inode_access (struct inode *inode, uint8_t *buffer, off_t size, off_t offset,
+		bool write, bool direct) {
+	off_t bytes_done = 0;
+	struct extent_cursor cursor = { 0, 0, 0 };
 
 	while (size > 0) {
-		/* Disk sector to read, starting byte offset within sector. */
-		disk_sector_t sector_idx = byte_to_sector (inode, offset);
+		/* Disk sector to access, starting byte offset within sector. */
+		rwlock_acquire_read (&inode->lock);
+		disk_sector_t sector_idx = byte_to_sector (inode, offset, &cursor);
+		off_t length = write && !direct ? inode->write_end : inode->data.length;
+		/* Sectors on from SECTOR_IDX that lie together on disk. */
+		size_t run = 0;
+		if (sector_idx != (disk_sector_t) -1) {
+			const struct extent *e = &inode->extents[cursor.hint];
+			run = e->logical + e->count - offset / DISK_SECTOR_SIZE;
+		}
+		rwlock_release_read (&inode->lock);
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
 
 		/* Bytes left in inode, bytes left in sector, lesser of the two. */
-		off_t inode_left = inode_length (inode) - offset;
+		off_t inode_left = (write && direct
+				? (off_t) ROUND_UP (length, DISK_SECTOR_SIZE) : length) - offset;
 		int sector_left = DISK_SECTOR_SIZE - sector_ofs;
 		int min_left = inode_left < sector_left ? inode_left : sector_left;
 
-		/* Number of bytes to actually copy out of this sector. */
+		/* Number of bytes to actually copy in this sector. */
 		int chunk_size = size < min_left ? size : min_left;
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Read full sector directly into caller's buffer. */
-			disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
-		} else {
-			/* Read sector into bounce buffer, then partially copy
-			 * into caller's buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-			disk_read (filesys_disk, sector_idx, bounce);
-			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-		}
+		if (sector_idx == (disk_sector_t) -1) {
+			if (write)
+				break;
+			memset (buffer + bytes_done, 0, chunk_size);
+		} else if (write && direct && sector_ofs == 0 && run > 1
+				&& size >= 2 * DISK_SECTOR_SIZE
+				&& inode_left >= 2 * DISK_SECTOR_SIZE) {
+			/* Whole sectors contiguous on disk go in one write. */
+			size_t cnt = size / DISK_SECTOR_SIZE;
+			if ((size_t) inode_left / DISK_SECTOR_SIZE < cnt)
+				cnt = inode_left / DISK_SECTOR_SIZE;
+			if (run < cnt)
+				cnt = run;
+			if (DISK_MAX_SECTORS < cnt)
+				cnt = DISK_MAX_SECTORS;
+			buffer_cache_write_direct_sectors (sector_idx, cnt,
+					buffer + bytes_done);
+			chunk_size = cnt * DISK_SECTOR_SIZE;
+		} else if (write && direct)
+			buffer_cache_write_direct (sector_idx, buffer + bytes_done,
+					sector_ofs, chunk_size);
+		else if (write) {
+			buffer_cache_write_at (sector_idx, buffer + bytes_done, sector_ofs,
+					chunk_size);
+			inode_extend (inode, offset + chunk_size);
+		} else if (direct)
+			buffer_cache_read_direct (sector_idx, buffer + bytes_done,
+					sector_ofs, chunk_size);
+		else
+			buffer_cache_read_at (sector_idx, buffer + bytes_done, sector_ofs,
+					chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
-		bytes_read += chunk_size;
+		bytes_done += chunk_size;
+	}
+	extent_cursor_done (&cursor);
+
+	return bytes_done;
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+ * Returns the number of bytes actually read, which may be less
+ * than SIZE if an error occurs or end of file is reached.
+ * Once the VM is up, file data is read through the page cache;
+ * before that, the sector after the last one read is read ahead. */
+static off_t
+inode_read (struct inode *inode, void *buffer, off_t size, off_t offset) {
+	off_t bytes_read;
+
+#ifdef VM
+	if (page_cache_enabled ())
+		return page_cache_read (inode, buffer, size, offset);
+#endif
+
+	bytes_read = inode_access (inode, buffer, size, offset, false, false);
+	if (bytes_read > 0) {
+		off_t next = ROUND_UP (offset + bytes_read, DISK_SECTOR_SIZE);
+		disk_sector_t sector;
+		struct extent_cursor cursor = { 0, 0, 0 };
+
+		rwlock_acquire_read (&inode->lock);
+		sector = byte_to_sector (inode, next, &cursor);
+		rwlock_release_read (&inode->lock);
+		extent_cursor_done (&cursor);
+		if (sector != (disk_sector_t) -1)
+			buffer_cache_read_ahead (sector);
 	}
-	free (bounce);
 
 	return bytes_read;
 }
 
+/* Gets INODE ready for a write of SIZE bytes at OFFSET whose data is
+ * mapped to disk sectors later, at writeback: reserves free sectors
+ * for the part past the end of INODE, and makes sure that writeback
+ * will find room in the extent table.  The file is extended only as
+ * the data gets in, so that readers never see the new part before
+ * its data.  Returns false if writes to INODE are denied or the disk
+ * or the extent table is full.
+ *
+ * Mapping a run of reserved sectors adds at most one extent and uses
+ * up at least one reserved sector.  So while the extents in use plus
+ * the reserved sectors fit in MAX_EXTENTS, writeback can always map
+ * delayed data.  A write that would break that has the holes it
+ * covers allocated (and zeroed) here instead, in no more extents than
+ * leaves room for the other reserved sectors, and fails now if that
+ * is impossible.  Sectors allocated before such a failure stay
+ * mapped, holding zeros, past the end of file if need be. */
+static bool
+inode_prepare_write (struct inode *inode, off_t size, off_t offset) {
+	uint32_t first = offset / DISK_SECTOR_SIZE;
+	uint32_t end = bytes_to_sectors (offset + size);
+	bool success = true;
+
+	rwlock_acquire_write (&inode->lock);
+	if (inode->deny_write_cnt > 0) {
+		rwlock_release_write (&inode->lock);
+		return false;
+	}
+	uint32_t old_end = bytes_to_sectors (inode->write_end);
+	size_t more = end > old_end ? end - old_end : 0;
+	if (more > 0) {
+		if (!free_map_reserve (more)) {
+			rwlock_release_write (&inode->lock);
+			return false;
+		}
+		inode->reserved += more;
+	}
+
+	if (inode->data.extent_cnt + inode->reserved > MAX_EXTENTS) {
+		size_t holes = inode_holes (inode, first, end - first);
+		size_t others = inode->reserved - (holes < inode->reserved
+				? holes : inode->reserved);
+		size_t limit = others < MAX_EXTENTS ? MAX_EXTENTS - others : 0;
+
+		success = inode_allocate (inode, first, end - first, true, limit);
+		if (!success && more > 0) {
+			/* Give back what is left of the new part's reservation. */
+			size_t left = inode_holes (inode, old_end, more);
+			if (left > inode->reserved)
+				left = inode->reserved;
+			free_map_unreserve (left);
+			inode->reserved -= left;
+		}
+	}
+
+	if (success && offset + size > inode->write_end)
+		inode->write_end = offset + size;
+	rwlock_release_write (&inode->lock);
+	return success;
+}
+
+/* Extends INODE to LENGTH bytes, if it is shorter, once the data up
+ * to there is in place. */
+void
+inode_extend (struct inode *inode, off_t length) {
+	rwlock_acquire_write (&inode->lock);
+	if (length > inode->data.length) {
+		inode->data.length = length;
+		inode->dirty = true;
+	}
+	rwlock_release_write (&inode->lock);
+}
+
+/* Allocates the holes among the sectors of SIZE bytes at OFFSET of
+ * INODE that lie within the file.  Returns false if the disk or the
+ * extent table is full. */
+static bool
+inode_allocate_range (struct inode *inode, off_t size, off_t offset,
+		bool zero) {
+	bool success = true;
+
+	rwlock_acquire_write (&inode->lock);
+	size_t first = offset / DISK_SECTOR_SIZE;
+	size_t end = bytes_to_sectors (offset + size);
+	size_t last = bytes_to_sectors (inode->write_end);
+	if (end > last)
+		end = last;
+	if (first < end)
+		success = inode_allocate (inode, first, end - first, zero,
+				MAX_EXTENTS);
+	rwlock_release_write (&inode->lock);
+	return success;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
  * Returns the number of bytes actually written, which may be
- * less than SIZE if end of file is reached or an error occurs.
- * (Normally a write at end of file would extend the inode, but
- * growth is not yet implemented.) */
-off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+ * less than SIZE if the disk is full or an error occurs.
+ * A write past the end of file extends it.  Through the page cache,
+ * the new sectors are allocated when the data is written back;
+ * otherwise they are allocated here. */
+static off_t
+inode_write (struct inode *inode, const void *buffer, off_t size,
 		off_t offset) {
-	const uint8_t *buffer = buffer_;
-	off_t bytes_written = 0;
-	uint8_t *bounce = NULL;
-
-	if (inode->deny_write_cnt)
+	if (size <= 0)
+		return 0;
+	if (!inode_prepare_write (inode, size, offset))
 		return 0;
 
-	while (size > 0) {
-		/* Sector to write, starting byte offset within sector. */
-		disk_sector_t sector_idx = byte_to_sector (inode, offset);
-		int sector_ofs = offset % DISK_SECTOR_SIZE;
+#ifdef VM
+	if (page_cache_enabled ())
+		return page_cache_write (inode, buffer, size, offset);
+#endif
 
-		/* Bytes left in inode, bytes left in sector, lesser of the two. */
-		off_t inode_left = inode_length (inode) - offset;
-		int sector_left = DISK_SECTOR_SIZE - sector_ofs;
-		int min_left = inode_left < sector_left ? inode_left : sector_left;
+	if (!inode_allocate_range (inode, size, offset, true))
+		return 0;
+	return inode_access (inode, (void *) buffer, size, offset, true, false);
+}
 
-		/* Number of bytes to actually write into this sector. */
-		int chunk_size = size < min_left ? size : min_left;
-		if (chunk_size <= 0)
-			break;
+/* Counts a read or write that begins (DELTA = 1) or ends (DELTA = -1),
+ * which shows how much file I/O goes on at once. */
+static void
+io_count (int delta) {
+	lock_acquire (&stat_lock);
+	io_cnt += delta;
+	if (io_cnt > io_peak_cnt)
+		io_peak_cnt = io_cnt;
+	lock_release (&stat_lock);
+}
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Write full sector directly to disk. */
-			disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
-		} else {
-			/* We need a bounce buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET,
+ * as inode_read() does. */
+off_t
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) {
+	io_count (1);
+	off_t bytes_read = inode_read (inode, buffer, size, offset);
+	io_count (-1);
+	return bytes_read;
+}
 
-			/* If the sector contains data before or after the chunk
-			   we're writing, then we need to read in the sector
-			   first.  Otherwise we start with a sector of all zeros. */
-			if (sector_ofs > 0 || chunk_size < sector_left) 
-				disk_read (filesys_disk, sector_idx, bounce);
-			else
-				memset (bounce, 0, DISK_SECTOR_SIZE);
-			memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			disk_write (filesys_disk, sector_idx, bounce); 
-		}
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET, as
+ * inode_write() does. */
+off_t
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
+		off_t offset) {
+	io_count (1);
+	off_t bytes_written = inode_write (inode, buffer, size, offset);
+	io_count (-1);
+	return bytes_written;
+}
 
-		/* Advance. */
-		size -= chunk_size;
-		offset += chunk_size;
-		bytes_written += chunk_size;
-	}
-	free (bounce);
+/* Like inode_read_at(), but neither through the page cache nor
+ * filling the buffer cache: how the page cache reads file data. */
+off_t
+inode_read_direct (struct inode *inode, void *buffer, off_t size,
+		off_t offset) {
+	return inode_access (inode, buffer, size, offset, false, true);
+}
 
-	return bytes_written;
+/* Like inode_write_at(), but neither through the page cache nor
+ * filling the buffer cache: how the page cache writes file data
+ * back.  Holes written here get their disk sectors now, and the
+ * write may cover the rest of the last sector.  Does not extend
+ * INODE.  Returns 0 if the holes cannot be allocated. */
+off_t
+inode_write_direct (struct inode *inode, const void *buffer, off_t size,
+		off_t offset) {
+	if (!inode_allocate_range (inode, size, offset, false))
+		return 0;
+	return inode_access (inode, (void *) buffer, size, offset, true, true);
 }
 
 /* Disables writes to INODE.
@@ -292,8 +900,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 	void
 inode_deny_write (struct inode *inode) 
 {
+	rwlock_acquire_write (&inode->lock);
 	inode->deny_write_cnt++;
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+	rwlock_release_write (&inode->lock);
 }
 
 /* Re-enables writes to INODE.
@@ -301,9 +911,11 @@ inode_deny_write (struct inode *inode)
  * inode_deny_write() on the inode, before closing the inode. */
 void
 inode_allow_write (struct inode *inode) {
+	rwlock_acquire_write (&inode->lock);
 	ASSERT (inode->deny_write_cnt > 0);
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
 	inode->deny_write_cnt--;
+	rwlock_release_write (&inode->lock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -311,3 +923,18 @@ off_t
 inode_length (const struct inode *inode) {
 	return inode->data.length;
 }
+
+/* Prints data allocation statistics.  Sectors per extent is how
+ * contiguous files came out on disk. */
+void
+inode_print_stats (void) {
+	printf ("Inodes: %lld sectors allocated in %lld runs, %lld at writeback; "
+			"%lld extents created (%lld sectors per extent)\n",
+			alloc_sector_cnt, alloc_run_cnt, delayed_sector_cnt, extent_new_cnt,
+			extent_new_cnt ? alloc_sector_cnt / extent_new_cnt : 0);
+	printf ("Inodes: %lld sector lookups, %lld without searching\n",
+			lookup_cnt, lookup_hit_cnt);
+	printf ("Inodes: %lld opens, %lld found already open\n",
+			open_call_cnt, open_hit_cnt);
+	printf ("Inodes: up to %d reads and writes at once\n", io_peak_cnt);
+}
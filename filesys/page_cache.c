@@ -1,9 +1,38 @@
-/* page_cache.c: Implementation of Page Cache (Buffer Cache). */
+/* page_cache.c: Implementation of Page Cache (Buffer Cache).
+ *
+ * File data is cached a page at a time in VM_PAGE_CACHE pages, found
+ * by (inode, offset) through pc_index.  Their frames are ordinary
+ * frames: the clock evicts them, writing them back through swap_out,
+ * and claims them again through swap_in.  read() and write() copy to
+ * and from these frames, and mmap pages map the very same frames, so
+ * there is a single copy of each page of a file in memory.  The worker
+ * thread reads ahead of sequential read()s and writes dirty pages back
+ * in the background. */
 
 #include "vm/vm.h"
+#ifdef VM
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall-nr.h>
+#include "devices/disk.h"
+#include "devices/timer.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define PC_POLL_INTERVAL (TIMER_FREQ / 20)	/* Ticks between worker wakeups. */
+#define PC_WRITEBACK_INTERVAL TIMER_FREQ	/* Ticks between writebacks. */
+#define PC_RA_QUEUE 16						/* Pending read-ahead requests. */
+#define PC_WRITEBACK_BATCH 16				/* Pages per writeback pass. */
+
 static bool page_cache_readahead (struct page *page, void *kva);
 static bool page_cache_writeback (struct page *page);
 static void page_cache_destroy (struct page *page);
+static void page_cache_kworkerd (void *aux);
 
 /* DO NOT MODIFY this struct */
 static const struct page_operations page_cache_op = {
@@ -15,36 +44,618 @@ static const struct page_operations page_cache_op = {
 
 tid_t page_cache_workerd;
 
+/* pc_lock protects pc_index, the read-ahead queue and each cache
+ * page's pin count and busy flag.  No disk I/O happens under it: a
+ * page being brought in is marked busy, so that two users of the same
+ * page never both claim a frame for it, and others wait on
+ * pc_settled. */
+static struct hash pc_index;
+static struct lock pc_lock;
+static struct condition pc_settled;	/* A page stopped being busy or pinned. */
+
+/* The worker thread, owner of every cache page.  Null until the page
+ * cache is up. */
+static struct thread *pc_owner;
+static struct semaphore pc_started;
+
+/* Pages waiting for the worker to read them ahead. */
+struct pc_ra {
+	struct inode *inode;
+	off_t ofs;
+};
+static struct pc_ra ra_queue[PC_RA_QUEUE];
+static size_t ra_head, ra_len;
+
+/* Statistics. */
+static long long hit_cnt;			/* # of read()/write() pages found resident. */
+static long long miss_cnt;			/* # of read()/write() pages read from disk. */
+static long long ra_cnt;			/* # of pages read ahead by the worker. */
+static long long wb_cnt;			/* # of dirty pages written back. */
+
+static uint64_t
+pc_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct page_cache *pc = hash_entry (e, struct page_cache, elem);
+	return hash_bytes (&pc->inode, sizeof pc->inode) * 31 + hash_int (pc->ofs);
+}
+
+static bool
+pc_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct page_cache *a = hash_entry (a_, struct page_cache, elem);
+	const struct page_cache *b = hash_entry (b_, struct page_cache, elem);
+
+	if (a->inode != b->inode)
+		return a->inode < b->inode;
+	return a->ofs < b->ofs;
+}
+
 /* The initializer of file vm */
 void
 pagecache_init (void) {
 	/* TODO: Create a worker daemon for page cache with page_cache_kworkerd */
+	hash_init (&pc_index, pc_hash, pc_less, NULL);
+	lock_init (&pc_lock);
+	cond_init (&pc_settled);
+	sema_init (&pc_started, 0);
+	page_cache_workerd = thread_create ("kworkerd", PRI_DEFAULT,
+			page_cache_kworkerd, NULL);
+	if (page_cache_workerd == TID_ERROR)
+		PANIC ("Failed to start the page cache worker.");
+	sema_down (&pc_started);
+}
+
+/* Returns true once file data goes through the page cache.  Until
+ * the VM is up, the file system reads and writes sectors directly. */
+bool
+page_cache_enabled (void) {
+	return pc_owner != NULL;
 }
 
 /* Initialize the page cache */
 bool
-page_cache_initializer (struct page *page, enum vm_type type, void *kva) {
+page_cache_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
 	/* Set up the handler */
 	page->operations = &page_cache_op;
 
+	page->va = NULL;
+	page->frame = NULL;
+	page->writable = true;
+	page->owner = pc_owner;
+	page->advice = MADV_NORMAL;
+	page->page_cache.dirty = false;
+	page->page_cache.accessed = false;
+	page->page_cache.pin_cnt = 0;
+	page->page_cache.busy = false;
+	return true;
+}
+
+/* Returns the cache page for OFS of INODE, or a null pointer.
+ * Must be called with pc_lock held. */
+static struct page *
+pc_lookup (struct inode *inode, off_t ofs) {
+	struct page key;
+	struct hash_elem *e;
+
+	key.page_cache.inode = inode;
+	key.page_cache.ofs = ofs;
+	e = hash_find (&pc_index, &key.page_cache.elem);
+	return e != NULL ? hash_entry (e, struct page, page_cache.elem) : NULL;
+}
+
+/* Returns the cache page for OFS of INODE resident and pinned, adding
+ * it to the cache if needed.  Returns a null pointer if out of memory.
+ * Must be called with pc_lock held, which is released while the page
+ * is read in. */
+static struct page *
+pc_get (struct inode *inode, off_t ofs) {
+	struct page *page;
+
+	while ((page = pc_lookup (inode, ofs)) != NULL && page->page_cache.busy)
+		cond_wait (&pc_settled, &pc_lock);
+	if (page == NULL) {
+		page = malloc (sizeof *page);
+		if (page == NULL)
+			return NULL;
+		page_cache_initializer (page, VM_PAGE_CACHE, NULL);
+		page->page_cache.inode = inode;
+		page->page_cache.ofs = ofs;
+		hash_insert (&pc_index, &page->page_cache.elem);
+	}
+	if (page->page_cache.pin_cnt++ == 0) {
+		bool ok;
+
+		page->page_cache.busy = true;
+		lock_release (&pc_lock);
+		ok = page_pin (page);
+		lock_acquire (&pc_lock);
+		page->page_cache.busy = false;
+		cond_broadcast (&pc_settled, &pc_lock);
+		if (!ok) {
+			page->page_cache.pin_cnt--;
+			return NULL;
+		}
+	}
+	return page;
+}
+
+/* Drops a pin taken by pc_get().  Must be called with pc_lock held. */
+static void
+pc_put (struct page *page) {
+	ASSERT (page->page_cache.pin_cnt > 0);
+	if (--page->page_cache.pin_cnt == 0) {
+		page_unpin (page);
+		cond_broadcast (&pc_settled, &pc_lock);
+	}
+}
+
+/* Returns the page-aligned cache page that holds byte OFS of INODE,
+ * resident and pinned until page_cache_put(), or a null pointer if
+ * it could not be brought in. */
+struct page *
+page_cache_get (struct inode *inode, off_t ofs) {
+	struct page *page;
+
+	ASSERT (ofs % PGSIZE == 0);
+
+	lock_acquire (&pc_lock);
+	page = pc_lookup (inode, ofs);
+	if (page != NULL && page->frame != NULL)
+		hit_cnt++;
+	else
+		miss_cnt++;
+	page = pc_get (inode, ofs);
+	lock_release (&pc_lock);
+	return page;
+}
+
+/* Releases a page returned by page_cache_get(). */
+void
+page_cache_put (struct page *page) {
+	lock_acquire (&pc_lock);
+	pc_put (page);
+	lock_release (&pc_lock);
+}
+
+/* Asks the worker to read the page at OFS of INODE ahead, unless it
+ * is cached already or too many requests are pending. */
+static void
+page_cache_read_ahead (struct inode *inode, off_t ofs) {
+	lock_acquire (&pc_lock);
+	if (pc_lookup (inode, ofs) == NULL && ra_len < PC_RA_QUEUE) {
+		struct pc_ra *last = &ra_queue[(ra_head + ra_len - 1) % PC_RA_QUEUE];
+		if (ra_len == 0 || last->inode != inode || last->ofs != ofs) {
+			struct pc_ra *ra = &ra_queue[(ra_head + ra_len++) % PC_RA_QUEUE];
+			ra->inode = inode;
+			ra->ofs = ofs;
+		}
+	}
+	lock_release (&pc_lock);
+}
+
+/* Copies SIZE bytes at OFFSET of INODE into or out of BUFFER through
+ * the cache.  A read stops at the end of the file; a write extends
+ * the file as its data gets in, before the page is marked dirty, so
+ * that writeback sees the new length.  Returns the number of bytes
+ * copied. */
+static off_t
+pc_access (struct inode *inode, uint8_t *buffer, off_t size, off_t offset,
+		bool write) {
+	off_t length = write ? offset + size : inode_length (inode);
+	off_t done = 0;
+
+	while (size > 0 && offset < length) {
+		off_t page_ofs = offset % PGSIZE;
+		off_t chunk = PGSIZE - page_ofs;
+		if (chunk > size)
+			chunk = size;
+		if (chunk > length - offset)
+			chunk = length - offset;
+
+		struct page *page = page_cache_get (inode, offset - page_ofs);
+		if (page == NULL)
+			break;
+		uint8_t *kva = (uint8_t *) page->frame->kva + page_ofs;
+		if (write) {
+			memcpy (kva, buffer + done, chunk);
+			inode_extend (inode, offset + chunk);
+			page->page_cache.dirty = true;
+		} else
+			memcpy (buffer + done, kva, chunk);
+		page->page_cache.accessed = true;
+		page_cache_put (page);
+
+		size -= chunk;
+		offset += chunk;
+		done += chunk;
+	}
+	return done;
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at OFFSET, and
+ * has the page after the last one read brought in ahead.
+ * Returns the number of bytes read. */
+off_t
+page_cache_read (struct inode *inode, void *buffer, off_t size,
+		off_t offset) {
+	off_t bytes_read = pc_access (inode, buffer, size, offset, false);
+
+	if (bytes_read > 0) {
+		off_t next = ROUND_UP (offset + bytes_read, PGSIZE);
+		if (next < inode_length (inode))
+			page_cache_read_ahead (inode, next);
+	}
+	return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET, which
+ * inode_write_at() got ready.  The data reaches the disk when the page is
+ * written back.  Returns the number of bytes written. */
+off_t
+page_cache_write (struct inode *inode, const void *buffer, off_t size,
+		off_t offset) {
+	return pc_access (inode, (void *) buffer, size, offset, true);
+}
+
+/* Returns true if cache PAGE or one of the mmap pages sharing its
+ * frame was written since it was last written back. */
+bool
+page_cache_is_dirty (struct page *page) {
+	struct list_elem *e;
+
+	if (page->frame == NULL)
+		return false;
+	if (page->page_cache.dirty)
+		return true;
+	for (e = list_begin (&page->frame->pages); e != list_end (&page->frame->pages);
+			e = list_next (e)) {
+		struct page *p = list_entry (e, struct page, share_elem);
+		if (p != page && p->owner->pml4 != NULL
+				&& pml4_is_dirty (p->owner->pml4, p->va))
+			return true;
+	}
+	return false;
+}
+
+/* Marks resident cache PAGE and the mmap pages sharing its frame
+ * clean, before its data is written back, so that a write meanwhile
+ * is not lost.  The caller must hold the frame lock.  Returns true if
+ * the page was dirty. */
+bool
+page_cache_clean (struct page *page) {
+	struct page_cache *pc = &page->page_cache;
+	struct list_elem *e;
+	bool dirty;
+
+	ASSERT (page->frame != NULL);
+
+	dirty = pc->dirty;
+	pc->dirty = false;
+	for (e = list_begin (&page->frame->pages); e != list_end (&page->frame->pages);
+			e = list_next (e)) {
+		struct page *p = list_entry (e, struct page, share_elem);
+		if (p != page && p->owner->pml4 != NULL
+				&& pml4_is_dirty (p->owner->pml4, p->va)) {
+			pml4_set_dirty (p->owner->pml4, p->va, false);
+			dirty = true;
+		}
+	}
+	return dirty;
+}
+
+/* Writes the data of the CNT cache PAGES, which page_cache_clean()
+ * found dirty and which hold consecutive pages of one file, back to
+ * it in a single write.  Their frames must stay put meanwhile: the
+ * caller holds the frame lock or a pin on each.  If the write fails,
+ * the pages are marked dirty again.  Returns the number of pages
+ * written. */
+static size_t
+pc_write_run (struct page **pages, size_t cnt) {
+	struct page_cache *pc = &pages[0]->page_cache;
+	void *buffer = pages[0]->frame->kva;
+	size_t i;
+
+	/* The tail of the last page lies past the end of the file.  It is
+	 * zero, so the last sector is written whole and needs no reading
+	 * back first, even if it was never allocated. */
+	off_t bytes = ROUND_UP (inode_length (pc->inode) - pc->ofs,
+			DISK_SECTOR_SIZE);
+	if (bytes > (off_t) (cnt * PGSIZE))
+		bytes = cnt * PGSIZE;
+
+	/* Gather the run, so that the disk sees one write. */
+	if (cnt > 1) {
+		buffer = malloc (cnt * PGSIZE);
+		if (buffer == NULL) {
+			size_t written = 0;
+			for (i = 0; i < cnt; i++)
+				written += pc_write_run (pages + i, 1);
+			return written;
+		}
+		for (i = 0; i < cnt; i++)
+			memcpy ((uint8_t *) buffer + i * PGSIZE, pages[i]->frame->kva,
+					PGSIZE);
+	}
+
+	bool ok = bytes <= 0
+		|| inode_write_direct (pc->inode, buffer, bytes, pc->ofs) == bytes;
+	if (cnt > 1)
+		free (buffer);
+	if (!ok) {
+		/* Keep the data until it can be written. */
+		for (i = 0; i < cnt; i++)
+			pages[i]->page_cache.dirty = true;
+		return 0;
+	}
+	wb_cnt += cnt;
+	return cnt;
+}
+
+/* Writes back the CNT cache PAGES, which page_cache_clean() found
+ * dirty and which are in file offset order, each run of consecutive
+ * pages of a file in one write.  Returns the number of pages
+ * written. */
+static size_t
+pc_write_runs (struct page **pages, size_t cnt) {
+	size_t i, j, written = 0;
+
+	for (i = 0; i < cnt; i = j) {
+		struct page_cache *first = &pages[i]->page_cache;
+		for (j = i + 1; j < cnt; j++) {
+			struct page_cache *pc = &pages[j]->page_cache;
+			if (pc->inode != first->inode
+					|| pc->ofs != first->ofs + (off_t) ((j - i) * PGSIZE))
+				break;
+		}
+		written += pc_write_run (pages + i, j - i);
+	}
+	return written;
+}
+
+/* Writes cache PAGE back to its file if it is resident and dirty, and
+ * marks it and its mappings clean.  The caller must hold the frame
+ * lock.  Returns true if the page was written. */
+bool
+page_cache_write_back (struct page *page) {
+	if (page->frame == NULL || !page_cache_clean (page))
+		return false;
+	return pc_write_run (&page, 1) == 1;
+}
+
+/* Writes the cached page at OFS of INODE back now if it or a mapping
+ * of it is dirty, for msync.  The page is pinned, and no lock is held
+ * while it is written.  Returns true if it was written. */
+bool
+page_cache_sync (struct inode *inode, off_t ofs) {
+	struct page *page;
+	bool written;
+
+	if (!page_cache_enabled ())
+		return false;
+	lock_acquire (&pc_lock);
+	page = pc_lookup (inode, ofs);
+	if (page != NULL && page->frame != NULL)
+		page = pc_get (inode, ofs);
+	else
+		page = NULL;
+	lock_release (&pc_lock);
+	if (page == NULL)
+		return false;
+
+	written = vm_pin_cache_page (page) && pc_write_run (&page, 1) == 1;
+	page_cache_put (page);
+	return written;
+}
+
+/* Orders cache pages by file, then by offset. */
+bool
+page_cache_less (const struct page *a, const struct page *b) {
+	return pc_less (&a->page_cache.elem, &b->page_cache.elem, NULL);
 }
 
 /* Utilze the Swap in mechanism to implement readhead */
 static bool
 page_cache_readahead (struct page *page, void *kva) {
+	struct page_cache *pc = &page->page_cache;
+	off_t bytes = inode_length (pc->inode) - pc->ofs;
+
+	if (bytes > PGSIZE)
+		bytes = PGSIZE;
+	if (bytes < 0)
+		bytes = 0;
+	if (inode_read_direct (pc->inode, kva, bytes, pc->ofs) != bytes)
+		return false;
+	memset ((uint8_t *) kva + bytes, 0, PGSIZE - bytes);
+	return true;
 }
 
 /* Utilze the Swap out mechanism to implement writeback */
 static bool
 page_cache_writeback (struct page *page) {
+	page_cache_write_back (page);
+	return !page->page_cache.dirty;
 }
 
 /* Destory the page_cache. */
 static void
 page_cache_destroy (struct page *page) {
+	page_cache_write_back (page);
+	vm_free_frame (page);
+}
+
+/* Returns a page of INODE in the cache, preferring one that no one
+ * has pinned, or a null pointer if there is none.  Sets *SETTLED to
+ * false if some page of INODE is pinned.  Must be called with pc_lock
+ * held. */
+static struct page *
+pc_find_inode (struct inode *inode, bool *settled) {
+	struct page *found = NULL;
+	struct hash_iterator i;
+
+	*settled = true;
+	hash_first (&i, &pc_index);
+	while (hash_next (&i)) {
+		struct page *page = hash_entry (hash_cur (&i), struct page,
+				page_cache.elem);
+		if (page->page_cache.inode != inode)
+			continue;
+		if (page->page_cache.pin_cnt > 0)
+			*settled = false;
+		else if (found == NULL)
+			found = page;
+	}
+	return found;
+}
+
+/* Removes the cached pages of INODE, which its last opener closed,
+ * writing dirty ones back first if WRITE_BACK.  No mmap maps them
+ * anymore, since a mapping keeps the file open, and no read() or
+ * write() can find them.  Pages past the end of the file go too.
+ * Each batch is pinned under pc_lock, written back without any lock
+ * and unlinked under pc_lock again. */
+void
+page_cache_drop (struct inode *inode, bool write_back) {
+	struct page *batch[PC_WRITEBACK_BATCH];
+	size_t i, cnt, kept = 0;
+
+	lock_acquire (&pc_lock);
+	for (i = 0; i < ra_len; i++) {
+		struct pc_ra ra = ra_queue[(ra_head + i) % PC_RA_QUEUE];
+		if (ra.inode != inode)
+			ra_queue[(ra_head + kept++) % PC_RA_QUEUE] = ra;
+	}
+	ra_len = kept;
+
+	do {
+		struct page *dirty[PC_WRITEBACK_BATCH];
+		size_t dirty_cnt = 0;
+		bool settled;
+
+		/* The worker may still be reading some ahead or writing them
+		 * back. */
+		for (;;) {
+			pc_find_inode (inode, &settled);
+			if (settled)
+				break;
+			cond_wait (&pc_settled, &pc_lock);
+		}
+
+		/* Pin a batch in file offset order. */
+		for (cnt = 0; cnt < PC_WRITEBACK_BATCH; cnt++) {
+			struct page *page = pc_find_inode (inode, &settled);
+			if (page == NULL)
+				break;
+			page->page_cache.pin_cnt++;
+			for (i = cnt; i > 0 && page_cache_less (page, batch[i - 1]); i--)
+				batch[i] = batch[i - 1];
+			batch[i] = page;
+		}
+		for (i = 0; i < cnt; i++)
+			if (vm_pin_cache_page (batch[i]) && write_back)
+				dirty[dirty_cnt++] = batch[i];
+		lock_release (&pc_lock);
+
+		pc_write_runs (dirty, dirty_cnt);
+
+		/* The frames stay pinned until they are freed.  A page that
+		 * could not be written is lost with the file's last opener. */
+		lock_acquire (&pc_lock);
+		for (i = 0; i < cnt; i++) {
+			struct page *page = batch[i];
+			page->page_cache.pin_cnt--;
+			hash_delete (&pc_index, &page->page_cache.elem);
+			page->page_cache.dirty = false;
+			vm_destroy_page (page);
+		}
+	} while (cnt == PC_WRITEBACK_BATCH);
+	lock_release (&pc_lock);
+}
+
+/* Writes back up to PC_WRITEBACK_BATCH dirty pages in file offset
+ * order, each run of consecutive pages of a file in one write.  The
+ * pages are pinned rather than the frame lock held while they are
+ * written.  Returns the number of pages written, and sets *MORE if the
+ * batch was full and some page was written, so more may be left. */
+static size_t
+pc_write_back_batch (bool *more) {
+	struct page *batch[PC_WRITEBACK_BATCH];
+	size_t cnt, i, written;
+
+	lock_acquire (&pc_lock);
+	cnt = vm_collect_dirty_cache (batch, PC_WRITEBACK_BATCH);
+	for (i = 0; i < cnt; i++)
+		batch[i]->page_cache.pin_cnt++;
+	lock_release (&pc_lock);
+
+	written = pc_write_runs (batch, cnt);
+
+	lock_acquire (&pc_lock);
+	for (i = 0; i < cnt; i++)
+		pc_put (batch[i]);
+	lock_release (&pc_lock);
+	*more = cnt == PC_WRITEBACK_BATCH && written > 0;
+	return written;
+}
+
+/* Writes every dirty cached page back to disk.  Returns the number of
+ * pages written. */
+size_t
+page_cache_flush (void) {
+	size_t written = 0;
+	bool more = page_cache_enabled ();
+
+	while (more)
+		written += pc_write_back_batch (&more);
+	return written;
+}
+
+/* Reads the queued pages ahead while frames are free; never evicts
+ * for a guess. */
+static void
+pc_read_ahead_queued (void) {
+	lock_acquire (&pc_lock);
+	while (ra_len > 0) {
+		struct pc_ra ra = ra_queue[ra_head];
+		ra_head = (ra_head + 1) % PC_RA_QUEUE;
+		ra_len--;
+
+		if (palloc_user_free_pages () <= vm_low_watermark)
+			continue;
+		if (pc_lookup (ra.inode, ra.ofs) != NULL)
+			continue;
+		struct page *page = pc_get (ra.inode, ra.ofs);
+		if (page != NULL) {
+			pc_put (page);
+			ra_cnt++;
+		}
+	}
+	lock_release (&pc_lock);
 }
 
 /* Worker thread for page cache */
 static void
-page_cache_kworkerd (void *aux) {
+page_cache_kworkerd (void *aux UNUSED) {
+	int64_t last_wb = timer_ticks ();
+
+	pc_owner = thread_current ();
+	sema_up (&pc_started);
+	for (;;) {
+		timer_sleep (PC_POLL_INTERVAL);
+		pc_read_ahead_queued ();
+		if (timer_elapsed (last_wb) >= PC_WRITEBACK_INTERVAL) {
+			page_cache_flush ();
+			last_wb = timer_ticks ();
+		}
+	}
+}
+
+/* Prints page cache statistics. */
+void
+page_cache_print_stats (void) {
+	long long lookups = hit_cnt + miss_cnt;
+
+	printf ("Page cache: %lld hits, %lld misses (hit rate %lld%%), "
+			"%lld pages read ahead, %lld written back\n", hit_cnt, miss_cnt,
+			lookups ? hit_cnt * 100 / lookups : 0, ra_cnt, wb_cnt);
 }
+#endif /* VM */
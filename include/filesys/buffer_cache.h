@@ -0,0 +1,21 @@
+#ifndef FILESYS_BUFFER_CACHE_H
+#define FILESYS_BUFFER_CACHE_H
+
+#include "devices/disk.h"
+
+void buffer_cache_init (void);
+void buffer_cache_read (disk_sector_t, void *);
+void buffer_cache_write (disk_sector_t, const void *);
+void buffer_cache_write_through (disk_sector_t, const void *);
+void buffer_cache_read_at (disk_sector_t, void *, int ofs, int size);
+void buffer_cache_write_at (disk_sector_t, const void *, int ofs, int size);
+void buffer_cache_read_direct (disk_sector_t, void *, int ofs, int size);
+void buffer_cache_write_direct (disk_sector_t, const void *, int ofs, int size);
+void buffer_cache_write_direct_sectors (disk_sector_t, size_t cnt,
+		const void *);
+void buffer_cache_read_ahead (disk_sector_t);
+void buffer_cache_flush (void);
+void buffer_cache_done (void);
+void buffer_cache_print_stats (void);
+
+#endif /* filesys/buffer_cache.h */
@@ -0,0 +1,17 @@
+#ifndef FILESYS_DENTRY_H
+#define FILESYS_DENTRY_H
+
+#include <stdbool.h>
+#include "devices/disk.h"
+
+struct inode;
+
+void dentry_init (void);
+struct inode *dentry_open (disk_sector_t parent, const char *name,
+		bool *cached);
+void dentry_set (disk_sector_t parent, const char *name, disk_sector_t);
+void dentry_set_negative (disk_sector_t parent, const char *name);
+void dentry_forget_dir (disk_sector_t parent);
+void dentry_print_stats (void);
+
+#endif /* filesys/dentry.h */
@@ -10,8 +10,14 @@ void free_map_read (void);
 void free_map_create (void);
 void free_map_open (void);
 void free_map_close (void);
+void free_map_sync (void);
+void free_map_print_stats (void);
 
 bool free_map_allocate (size_t, disk_sector_t *);
+bool free_map_allocate_reserved (size_t, size_t reserved, disk_sector_t *);
+bool free_map_allocate_at (disk_sector_t, size_t, size_t reserved);
 void free_map_release (disk_sector_t, size_t);
+bool free_map_reserve (size_t);
+void free_map_unreserve (size_t);
 
 #endif /* filesys/free-map.h */
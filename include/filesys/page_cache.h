@@ -1,12 +1,40 @@
 #ifndef FILESYS_PAGE_CACHE_H
 #define FILESYS_PAGE_CACHE_H
-#include "vm/vm.h"
+#include <hash.h>
+#include <stdbool.h>
+#include "filesys/off_t.h"
 
 struct page;
+struct inode;
 enum vm_type;
 
-struct page_cache {};
+/* One page of file data in the page cache.  The page lives in the
+ * frame table like any user page, with the page cache worker as its
+ * owner and no virtual address, and mmap pages of the same file share
+ * its frame. */
+struct page_cache {
+	struct inode *inode;        /* File the data belongs to. */
+	off_t ofs;                  /* Page-aligned offset in the file. */
+	bool dirty;                 /* Changed by write() since written back. */
+	bool accessed;              /* Used by read()/write() since the last sweep. */
+	int pin_cnt;                /* Users that need the frame resident. */
+	bool busy;                  /* Being read in; others wait for it. */
+	struct hash_elem elem;      /* Element in the page cache index. */
+};
 
-void page_cache_init (void);
+void pagecache_init (void);
 bool page_cache_initializer (struct page *page, enum vm_type type, void *kva);
+bool page_cache_enabled (void);
+off_t page_cache_read (struct inode *, void *, off_t size, off_t offset);
+off_t page_cache_write (struct inode *, const void *, off_t size, off_t offset);
+struct page *page_cache_get (struct inode *, off_t ofs);
+void page_cache_put (struct page *);
+bool page_cache_is_dirty (struct page *);
+bool page_cache_clean (struct page *);
+bool page_cache_write_back (struct page *);
+bool page_cache_sync (struct inode *, off_t ofs);
+bool page_cache_less (const struct page *, const struct page *);
+void page_cache_drop (struct inode *, bool write_back);
+size_t page_cache_flush (void);
+void page_cache_print_stats (void);
 #endif
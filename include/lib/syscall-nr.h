@@ -36,6 +36,33 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	/* Extra for Project 3 */
+	SYS_MSYNC,                  /* Write back a memory mapping. */
+	SYS_MADVISE,                /* Give advice about use of memory. */
+	SYS_MEMSTAT,                /* Read the process's memory counters. */
+	SYS_RSSLIMIT,               /* Cap the process's resident set. */
+};
+
+/* Flag for SYS_MMAP's WRITABLE argument: fault in the whole mapping
+ * up front. */
+#define MAP_POPULATE 0x2
+
+/* Advice values for SYS_MADVISE. */
+enum {
+	MADV_NORMAL,                /* No special treatment. */
+	MADV_RANDOM,                /* No read-ahead. */
+	MADV_SEQUENTIAL,            /* Aggressive read-ahead, early eviction. */
+	MADV_WILLNEED,              /* Read the range in now. */
+	MADV_DONTNEED,              /* Drop the range's frames and swap. */
+};
+
+/* Memory counters of a process, in pages, for SYS_MEMSTAT. */
+struct memstat {
+	unsigned long rss;          /* Pages resident in frames. */
+	unsigned long swap;         /* Anonymous pages swapped out. */
+	unsigned long mmap;         /* Pages of file mappings. */
+	unsigned long rss_limit;    /* Resident-set cap, or 0 for none. */
 };
 
 #endif /* lib/syscall-nr.h */
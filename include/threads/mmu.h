@@ -3,12 +3,14 @@
 #define THREAD_MMU_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "threads/pte.h"
 
 typedef bool pte_for_each_func(uint64_t *pte, void *va, void *aux);
 
 uint64_t *pml4e_walk(uint64_t *pml4, const uint64_t va, int create);
+uint64_t *pml4_pde_walk(uint64_t *pml4, const uint64_t va, int create);
 uint64_t *pml4_create(void);
 bool pml4_for_each(uint64_t *, pte_for_each_func *, void *);
 void pml4_destroy(uint64_t *pml4);
@@ -20,6 +22,14 @@ bool pml4_is_dirty(uint64_t *pml4, const void *upage);
 void pml4_set_dirty(uint64_t *pml4, const void *upage, bool dirty);
 bool pml4_is_accessed(uint64_t *pml4, const void *upage);
 void pml4_set_accessed(uint64_t *pml4, const void *upage, bool accessed);
+bool pml4_set_huge_page(uint64_t *pml4, void *upage, void *kpage, bool rw);
+bool pml4_is_huge(uint64_t *pml4, const void *upage);
+size_t pml4_huge_split_cnt(void);
+void pml4_clear_range(uint64_t *pml4, void *start, void *end);
+bool pml4_protect_range(uint64_t *pml4, void *start, void *end);
+void pml4_destroy_range(uint64_t *pml4, void *start, void *end);
+bool pml4_copy_range(uint64_t *dst, uint64_t *src, void *start, void *end,
+					 pte_for_each_func *filter, void *aux);
 
 #define is_writable(pte) (*(pte)&PTE_W)
 #define is_user_pte(pte) (*(pte)&PTE_U)
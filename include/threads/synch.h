@@ -38,6 +38,25 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock.  Any number of readers or one writer may hold
+   it.  Waiting writers keep new readers out, so writers do not
+   starve. */
+struct rwlock {
+	struct lock lock;           /* Protects the members below. */
+	struct condition readers_ok; /* No writer holds or waits for it. */
+	struct condition writers_ok; /* No one holds it. */
+	int readers;                /* Number of readers holding it. */
+	int waiting_writers;        /* Number of writers waiting for it. */
+	struct thread *writer;      /* Writer holding it, if any. */
+};
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_by_current_thread (const struct rwlock *);
+
 /* Optimization barrier.
  *
  * The compiler will not reorder operations across an
@@ -3,5 +3,4 @@
 #include "threads/synch.h"
 
 void syscall_init(void);
-struct lock filesys_lock;
 #endif /* userprog/syscall.h */
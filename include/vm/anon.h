@@ -6,9 +6,17 @@ enum vm_type;
 
 struct anon_page {
     int swap_slot_no;
+    struct zram_obj *zobj;  /* Compressed copy in RAM, or NULL. */
+    bool zero_fill;         /* Started out as zeros, not file data. */
+    bool discarded;         /* Thrown away by MADV_DONTNEED: reads as zeros. */
 };
 
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+bool anon_swap_out_cluster (struct page **pages, size_t cnt);
+void anon_swap_share (struct page *dst, struct page *src);
+bool anon_is_swapped (struct page *page);
+void anon_discard (struct page *page);
+void anon_print_stats (void);
 
 #endif
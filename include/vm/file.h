@@ -18,4 +18,7 @@ bool file_backed_initializer (struct page *page, enum vm_type type, void *kva);
 void *do_mmap(void *addr, size_t length, int writable,
 		struct file *file, off_t offset);
 void do_munmap (void *va);
+bool do_msync (void *addr, size_t length);
+bool file_backed_writeback (struct page *page);
+void file_backed_print_stats (void);
 #endif
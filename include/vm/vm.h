@@ -2,6 +2,8 @@
 #define VM_VM_H
 #include <stdbool.h>
 #include "threads/palloc.h"
+#include "devices/disk.h"
+#include "filesys/off_t.h"
 #include "hash.h"
 
 enum vm_type
@@ -20,7 +22,7 @@ enum vm_type
 	/* Auxillary bit flag marker for store information. You can add more
 	 * markers, until the value is fit in the int. */
 	VM_MARKER_0 = (1 << 3), // 스택이 저장된 메모리 페이지 식별
-	VM_MARKER_1 = (1 << 4),
+	VM_MARKER_1 = (1 << 4), // 프로세스 간 공유 가능한 읽기 전용 코드 페이지
 
 	/* DO NOT EXCEED THIS VALUE. */
 	VM_MARKER_END = (1 << 31),
@@ -29,9 +31,7 @@ enum vm_type
 #include "vm/uninit.h"
 #include "vm/anon.h"
 #include "vm/file.h"
-#ifdef EFILESYS
 #include "filesys/page_cache.h"
-#endif
 
 struct page_operations;
 struct thread;
@@ -51,6 +51,9 @@ struct page
 	/* Your implementation */
 	struct hash_elem hash_elem;
 	bool writable;
+	struct thread *owner; /* Process whose pml4 maps this page. */
+	struct list_elem share_elem; /* Element in frame->pages. */
+	uint8_t advice;		 /* MADV_* hint given by madvise(). */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -59,9 +62,7 @@ struct page
 		struct uninit_page uninit;
 		struct anon_page anon;
 		struct file_page file;
-#ifdef EFILESYS
 		struct page_cache page_cache;
-#endif
 	};
 };
 
@@ -69,7 +70,23 @@ struct page
 struct frame
 {
 	void *kva;
-	struct page *page;
+	struct page *page;			 /* One of the pages below, used for swap out. */
+	struct list pages;			 /* Pages mapping this frame (copy-on-write). */
+	int ref_cnt;				 /* Number of pages in PAGES. */
+	struct list_elem frame_elem; /* Element in the global frame table. */
+	bool pinned;				 /* Not to be chosen as an eviction victim. */
+
+	/* Shared text index entry, valid if TEXT is true. */
+	bool text;
+	struct hash_elem text_elem;
+	disk_sector_t text_inode;	 /* Inode sector of the executable. */
+	off_t text_ofs;				 /* File offset of the page. */
+	uint32_t text_read_bytes;	 /* Bytes read from the file. */
+
+	/* Same-page merging index entry, valid if KSM is true. */
+	bool ksm;
+	struct hash_elem ksm_elem;
+	uint64_t ksm_hash;			 /* Hash of the contents when scanned. */
 };
 
 /* The function table for page operations.
@@ -96,6 +113,20 @@ struct page_operations
 struct supplemental_page_table
 {
 	struct hash spt_hash;
+
+	/* Sequential fault detection for read-ahead. */
+	void *ra_next;	  /* Address a sequential scan faults on next. */
+	size_t ra_window; /* Current read-ahead window, in pages. */
+
+	/* Memory accounting, in pages; see vm_account(). */
+	size_t rss_cnt;	  /* Pages holding a frame, shared ones included. */
+	size_t swap_cnt;  /* Anonymous pages swapped out, to RAM or disk. */
+	size_t mmap_cnt;  /* Pages of file mappings. */
+	size_t rss_limit; /* Cap on rss_cnt, or 0 for none. */
+
+	/* Set while pages are torn down ahead of one pml4_*_range() call,
+	 * so vm_free_frame() leaves the page table alone. */
+	bool unmap_deferred;
 };
 
 #include "threads/thread.h"
@@ -107,8 +138,23 @@ struct page *spt_find_page(struct supplemental_page_table *spt,
 						   void *va);
 bool spt_insert_page(struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page(struct supplemental_page_table *spt, struct page *page);
+void spt_remove_range(struct supplemental_page_table *spt, void *start,
+					  void *end);
+
+/* Free-frame watermarks for the reclaim daemon, in pages. */
+extern size_t vm_low_watermark;
+extern size_t vm_high_watermark;
+
+/* Map eligible 2MB-aligned blocks with 2MB pages (-thp). */
+extern bool vm_huge_pages;
+
+/* Frames the same-page merging daemon scans per wakeup, or 0 (-ksm). */
+extern size_t vm_ksm_pages;
 
 void vm_init(void);
+size_t vm_populate(void *addr, size_t length, bool force);
+bool vm_madvise(void *addr, size_t length, int advice);
+void vm_account(size_t *counter, int delta);
 bool vm_try_handle_fault(struct intr_frame *f, void *addr, bool user,
 						 bool write, bool not_present);
 
@@ -117,8 +163,17 @@ bool vm_try_handle_fault(struct intr_frame *f, void *addr, bool user,
 bool vm_alloc_page_with_initializer(enum vm_type type, void *upage,
 									bool writable, vm_initializer *init, void *aux);
 void vm_dealloc_page(struct page *page);
+void vm_destroy_page(struct page *page);
 bool vm_claim_page(void *va);
+bool page_pin(struct page *page);
+void page_unpin(struct page *page);
 enum vm_type page_get_type(struct page *page);
+void vm_free_frame(struct page *page);
+bool vm_writeback_page(struct page *page);
+void vm_writeback_kick(void);
+size_t vm_collect_dirty_cache(struct page **batch, size_t max);
+bool vm_pin_cache_page(struct page *page);
+void vm_print_stats(void);
 
 void spt_hash_destroy(struct hash_elem *e, void *aux);
 
@@ -0,0 +1,19 @@
+#ifndef VM_ZRAM_H
+#define VM_ZRAM_H
+#include <stdbool.h>
+#include <stddef.h>
+
+/* A compressed copy of one page held in the RAM swap tier. */
+struct zram_obj;
+
+/* Most kernel pages the tier may use.  0 disables it. */
+extern size_t zram_cap_pages;
+
+void zram_init (void);
+struct zram_obj *zram_store (const void *kva);
+void zram_load (struct zram_obj *obj, void *kva);
+void zram_get (struct zram_obj *obj);
+void zram_put (struct zram_obj *obj);
+void zram_print_stats (void);
+
+#endif
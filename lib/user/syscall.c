@@ -158,6 +158,26 @@ void munmap(void *addr)
 	syscall1(SYS_MUNMAP, addr);
 }
 
+int msync(void *addr, size_t length)
+{
+	return syscall2(SYS_MSYNC, addr, length);
+}
+
+int madvise(void *addr, size_t length, int advice)
+{
+	return syscall3(SYS_MADVISE, addr, length, advice);
+}
+
+int memstat(struct memstat *st)
+{
+	return syscall1(SYS_MEMSTAT, st);
+}
+
+size_t rsslimit(size_t pages)
+{
+	return (size_t)syscall1(SYS_RSSLIMIT, pages);
+}
+
 bool chdir(const char *dir)
 {
 	return syscall1(SYS_CHDIR, dir);
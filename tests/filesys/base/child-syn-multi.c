@@ -0,0 +1,64 @@
+/* Child process for syn-multi test.
+   Creates a file of its own, waits until every child has created
+   its file, then writes it a chunk at a time, closes it and reads it
+   back, so that each child does its I/O on a different file and only
+   contends with the others inside the file system.  Closing the file
+   sends its data to disk, so that reading it back waits for the disk
+   while the other children go on. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/filesys/base/syn-multi.h"
+
+const char *test_name = "child-syn-multi";
+
+static char buf[FILE_SIZE];
+static char chunk[CHUNK_SIZE];
+
+int
+main (int argc, const char *argv[]) 
+{
+  char file_name[16];
+  char other_name[16];
+  int child_idx;
+  int fd, i;
+  size_t ofs;
+
+  quiet = true;
+  
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+  snprintf (file_name, sizeof file_name, "multi%d", child_idx);
+
+  random_init (child_idx);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  for (i = 0; i < CHILD_CNT; i++) 
+    {
+      snprintf (other_name, sizeof other_name, "multi%d", i);
+      while ((fd = open (other_name)) < 0)
+        continue;
+      close (fd);
+    }
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (ofs = 0; ofs < sizeof buf; ofs += CHUNK_SIZE)
+    CHECK (write (fd, buf + ofs, CHUNK_SIZE) == CHUNK_SIZE,
+           "write \"%s\"", file_name);
+  close (fd);
+
+  CHECK ((fd = open (file_name)) > 1, "reopen \"%s\"", file_name);
+  for (ofs = 0; ofs < sizeof buf; ofs += CHUNK_SIZE) 
+    {
+      CHECK (read (fd, chunk, CHUNK_SIZE) == CHUNK_SIZE,
+             "read \"%s\"", file_name);
+      compare_bytes (chunk, buf + ofs, CHUNK_SIZE, ofs, file_name);
+    }
+  close (fd);
+
+  return child_idx;
+}
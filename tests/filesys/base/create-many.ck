@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(create-many) begin
+(create-many) created and removed 120 files
+(create-many) end
+EOF
+our ($test);
+my ($free, $mounted) = map (/^Free map: (\d+) sectors free, (\d+) when mounted$/,
+			    read_text_file ("$test.output"));
+fail "missing free map statistics\n" if !defined $mounted;
+fail "$free sectors free at shutdown, $mounted when mounted\n"
+  if $free != $mounted;
+pass;
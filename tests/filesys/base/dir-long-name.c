@@ -0,0 +1,24 @@
+/* Creates a file whose name is exactly 14 characters long, then
+   tries to open and remove a longer name that starts with it.
+   Neither may touch the 14-character file. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  const char *name = "abcdefghijklmn";
+  const char *long_name = "abcdefghijklmnop";
+  int fd;
+
+  CHECK (create (name, 0), "create \"%s\"", name);
+  CHECK (!create (long_name, 0), "create \"%s\" (must fail)", long_name);
+  CHECK (open (long_name) == -1, "open \"%s\" (must fail)", long_name);
+  CHECK (!remove (long_name), "remove \"%s\" (must fail)", long_name);
+  CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+  close (fd);
+  CHECK (open (long_name) == -1, "open \"%s\" again (must fail)", long_name);
+  CHECK (remove (name), "remove \"%s\"", name);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-long-name) begin
+(dir-long-name) create "abcdefghijklmn"
+(dir-long-name) create "abcdefghijklmnop" (must fail)
+(dir-long-name) open "abcdefghijklmnop" (must fail)
+(dir-long-name) remove "abcdefghijklmnop" (must fail)
+(dir-long-name) open "abcdefghijklmn"
+(dir-long-name) open "abcdefghijklmnop" again (must fail)
+(dir-long-name) remove "abcdefghijklmn"
+(dir-long-name) end
+EOF
+pass;
@@ -0,0 +1,57 @@
+/* Fills the root directory with many files, removes every other one
+   and creates them again, checking lookups along the way.  Each
+   lookup, create and remove should touch only the entry involved;
+   the directory statistics printed at shutdown show how many entries
+   had to be read. */
+
+#include <syscall.h>
+#include <stdio.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILES 200
+
+static char name[16];
+
+static const char *
+file_name (int i) 
+{
+  snprintf (name, sizeof name, "entry%d", i);
+  return name;
+}
+
+void
+test_main (void) 
+{
+  int i, fd;
+
+  msg ("create %d files", FILES);
+  for (i = 0; i < FILES; i++)
+    if (!create (file_name (i), 0))
+      fail ("create \"%s\"", name);
+
+  msg ("remove every other file");
+  for (i = 0; i < FILES; i += 2)
+    if (!remove (file_name (i)))
+      fail ("remove \"%s\"", name);
+
+  msg ("look up all files");
+  for (i = 0; i < FILES; i++) 
+    {
+      fd = open (file_name (i));
+      if (i % 2 == 0 && fd != -1)
+        fail ("removed \"%s\" still opens", name);
+      if (i % 2 == 1 && fd < 2)
+        fail ("open \"%s\"", name);
+      if (fd >= 2)
+        close (fd);
+    }
+
+  msg ("create the removed files again");
+  for (i = 0; i < FILES; i += 2)
+    if (!create (file_name (i), 0))
+      fail ("create \"%s\"", name);
+  for (i = 0; i < FILES; i++)
+    if (create (file_name (i), 0))
+      fail ("created \"%s\" twice", name);
+}
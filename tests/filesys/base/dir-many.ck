@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-many) begin
+(dir-many) create 200 files
+(dir-many) remove every other file
+(dir-many) look up all files
+(dir-many) create the removed files again
+(dir-many) end
+EOF
+pass;
@@ -0,0 +1,65 @@
+/* Grows two files in turn, one block at a time, then checks that
+   both read back correctly.  With allocation at write time the two
+   files' sectors interleave on disk; with allocation delayed until
+   writeback each file ends up in a few long extents.  The extent
+   counts printed at shutdown show which one happened. */
+
+#include <syscall.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCKS 64
+#define BLOCK_SIZE 512
+
+static char buf[BLOCK_SIZE];
+
+static void
+fill (int file, int block) 
+{
+  memset (buf, 'a' + (file * BLOCKS + block) % 26, sizeof buf);
+}
+
+void
+test_main (void) 
+{
+  const char *names[2] = {"grow-a", "grow-b"};
+  int fds[2];
+  int file, block;
+
+  for (file = 0; file < 2; file++) 
+    {
+      CHECK (create (names[file], 0), "create \"%s\"", names[file]);
+      CHECK ((fds[file] = open (names[file])) > 1, "open \"%s\"",
+             names[file]);
+    }
+
+  msg ("grow both files to %d bytes", BLOCKS * BLOCK_SIZE);
+  for (block = 0; block < BLOCKS; block++)
+    for (file = 0; file < 2; file++) 
+      {
+        fill (file, block);
+        if (write (fds[file], buf, sizeof buf) != BLOCK_SIZE)
+          fail ("write block %d of \"%s\"", block, names[file]);
+      }
+
+  msg ("verify both files");
+  for (file = 0; file < 2; file++) 
+    {
+      char data[BLOCK_SIZE];
+
+      if (filesize (fds[file]) != BLOCKS * BLOCK_SIZE)
+        fail ("\"%s\" is %d bytes", names[file], filesize (fds[file]));
+      seek (fds[file], 0);
+      for (block = 0; block < BLOCKS; block++) 
+        {
+          fill (file, block);
+          if (read (fds[file], data, sizeof data) != BLOCK_SIZE)
+            fail ("read block %d of \"%s\"", block, names[file]);
+          if (memcmp (data, buf, sizeof data))
+            fail ("block %d of \"%s\" differs", block, names[file]);
+        }
+      close (fds[file]);
+    }
+}
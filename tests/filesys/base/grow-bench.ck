@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-bench) begin
+(grow-bench) create "grow-a"
+(grow-bench) open "grow-a"
+(grow-bench) create "grow-b"
+(grow-bench) open "grow-b"
+(grow-bench) grow both files to 32768 bytes
+(grow-bench) verify both files
+(grow-bench) end
+EOF
+pass;
@@ -0,0 +1,55 @@
+/* Opens the same names over and over, some of them missing, as a
+   benchmark for name lookup.  After the first round every lookup
+   should be answered without reading the directory; the dentry cache
+   statistics printed at shutdown show how many were. */
+
+#include <syscall.h>
+#include <stdio.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILES 20
+#define MISSING 5
+#define ROUNDS 20
+
+static char name[16];
+
+static const char *
+file_name (const char *prefix, int i) 
+{
+  snprintf (name, sizeof name, "%s%d", prefix, i);
+  return name;
+}
+
+void
+test_main (void) 
+{
+  int round, i, fd;
+
+  msg ("create %d files", FILES);
+  for (i = 0; i < FILES; i++)
+    if (!create (file_name ("file", i), 0))
+      fail ("create \"%s\"", name);
+
+  msg ("open them and %d missing names %d times", MISSING, ROUNDS);
+  for (round = 0; round < ROUNDS; round++) 
+    {
+      for (i = 0; i < FILES; i++) 
+        {
+          fd = open (file_name ("file", i));
+          if (fd < 2)
+            fail ("open \"%s\" in round %d", name, round);
+          close (fd);
+        }
+      for (i = 0; i < MISSING; i++)
+        if (open (file_name ("none", i)) != -1)
+          fail ("opened missing \"%s\" in round %d", name, round);
+    }
+
+  msg ("remove a file and create a missing one");
+  CHECK (remove ("file0"), "remove \"file0\"");
+  CHECK (open ("file0") == -1, "open removed \"file0\"");
+  CHECK (create ("none0", 0), "create \"none0\"");
+  CHECK ((fd = open ("none0")) > 1, "open created \"none0\"");
+  close (fd);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(open-many) begin
+(open-many) create 20 files
+(open-many) open them and 5 missing names 20 times
+(open-many) remove a file and create a missing one
+(open-many) remove "file0"
+(open-many) open removed "file0"
+(open-many) create "none0"
+(open-many) open created "none0"
+(open-many) end
+EOF
+pass;
@@ -0,0 +1,29 @@
+/* Spawns 6 child processes, each of which writes and reads back a
+   file of its own, then checks that all the files are there with
+   the right size.  With no global file system lock the children's
+   I/O overlaps, which the kernel's inode statistics must show. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/filesys/base/syn-multi.h"
+
+void
+test_main (void) 
+{
+  pid_t children[CHILD_CNT];
+  char file_name[16];
+  int fd, i;
+
+  exec_children ("child-syn-multi", children, CHILD_CNT);
+  wait_children (children, CHILD_CNT);
+
+  for (i = 0; i < CHILD_CNT; i++) 
+    {
+      snprintf (file_name, sizeof file_name, "multi%d", i);
+      CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+      CHECK (filesize (fd) == FILE_SIZE, "size of \"%s\"", file_name);
+      close (fd);
+    }
+}
@@ -0,0 +1,38 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(syn-multi) begin
+(syn-multi) exec child 1 of 6: "child-syn-multi 0"
+(syn-multi) exec child 2 of 6: "child-syn-multi 1"
+(syn-multi) exec child 3 of 6: "child-syn-multi 2"
+(syn-multi) exec child 4 of 6: "child-syn-multi 3"
+(syn-multi) exec child 5 of 6: "child-syn-multi 4"
+(syn-multi) exec child 6 of 6: "child-syn-multi 5"
+(syn-multi) wait for child 1 of 6 returned 0 (expected 0)
+(syn-multi) wait for child 2 of 6 returned 1 (expected 1)
+(syn-multi) wait for child 3 of 6 returned 2 (expected 2)
+(syn-multi) wait for child 4 of 6 returned 3 (expected 3)
+(syn-multi) wait for child 5 of 6 returned 4 (expected 4)
+(syn-multi) wait for child 6 of 6 returned 5 (expected 5)
+(syn-multi) open "multi0"
+(syn-multi) size of "multi0"
+(syn-multi) open "multi1"
+(syn-multi) size of "multi1"
+(syn-multi) open "multi2"
+(syn-multi) size of "multi2"
+(syn-multi) open "multi3"
+(syn-multi) size of "multi3"
+(syn-multi) open "multi4"
+(syn-multi) size of "multi4"
+(syn-multi) open "multi5"
+(syn-multi) size of "multi5"
+(syn-multi) end
+EOF
+our ($test);
+my ($peak) = map (/^Inodes: up to (\d+) reads and writes at once$/,
+		  read_text_file ("$test.output"));
+fail "missing inode I/O statistics\n" if !defined $peak;
+fail "file I/O never overlapped (at most $peak at once)\n" if $peak < 2;
+pass;
@@ -0,0 +1,9 @@
+#ifndef TESTS_FILESYS_BASE_SYN_MULTI_H
+#define TESTS_FILESYS_BASE_SYN_MULTI_H
+
+#define CHILD_CNT 6
+#define CHUNK_SIZE 512
+#define CHUNK_CNT 32
+#define FILE_SIZE (CHUNK_SIZE * CHUNK_CNT)
+
+#endif /* tests/filesys/base/syn-multi.h */
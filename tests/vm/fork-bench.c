@@ -0,0 +1,62 @@
+/* Measures fork and exit of a process with 64MB resident.
+ * Touches every page of a 64MB array, then forks FORK_CNT children
+ * one at a time.  Each child checks every page it shares with the
+ * parent and writes one of them before exiting; the parent then
+ * checks that the write did not reach its own copy.  The time spent
+ * copying and tearing down address spaces is printed with the kernel
+ * statistics at shutdown. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define ARRAY_SIZE (64 << 20)
+#define PAGE_CNT (ARRAY_SIZE / PAGE_SIZE)
+#define FORK_CNT 8
+
+static uint8_t array[ARRAY_SIZE];
+
+/* Returns the byte page I of the array holds. */
+static uint8_t
+page_value (size_t i)
+{
+  return (i * 7 + 1) & 0xff;
+}
+
+static int
+child_main (size_t n)
+{
+  size_t i;
+
+  for (i = 0; i < PAGE_CNT; i++)
+    if (array[i * PAGE_SIZE] != page_value (i))
+      return 1;
+  array[n * PAGE_SIZE] = ~page_value (n);
+  return 0;
+}
+
+void
+test_main (void)
+{
+  size_t i, n;
+
+  for (i = 0; i < PAGE_CNT; i++)
+    array[i * PAGE_SIZE] = page_value (i);
+  msg ("touched %d pages", PAGE_CNT);
+
+  for (n = 0; n < FORK_CNT; n++)
+    {
+      pid_t pid = fork ("child");
+      if (pid == 0)
+        exit (child_main (n));
+      if (pid < 0)
+        fail ("fork #%zu failed", n);
+      if (wait (pid) != 0)
+        fail ("child #%zu saw wrong data", n);
+      if (array[n * PAGE_SIZE] != page_value (n))
+        fail ("child #%zu's write reached the parent", n);
+    }
+  msg ("forked and reaped %d children", FORK_CNT);
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-bench) begin
+(fork-bench) touched 16384 pages
+(fork-bench) forked and reaped 8 children
+(fork-bench) end
+EOF
+pass;
@@ -0,0 +1,38 @@
+/* Measures a TLB-sensitive workload under 2MB pages.
+ * Runs with -thp.  Touches a 2MB-aligned 4MB array at random
+ * offsets, which spreads the accesses over 1024 4KB pages but only
+ * two 2MB pages, then checks the sum.  The number of 2MB pages
+ * mapped and the page faults they saved are printed with the kernel
+ * statistics at shutdown, and the test fails unless some 2MB page
+ * was mapped. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ONE_MB (1 << 20)
+#define ARRAY_SIZE (4 * ONE_MB)
+#define ACCESS_CNT (1 << 20)
+
+static uint8_t array[ARRAY_SIZE] __attribute__ ((aligned (2 * ONE_MB)));
+
+void
+test_main (void)
+{
+  uint32_t seed = 1;
+  size_t i, sum = 0;
+
+  for (i = 0; i < ACCESS_CNT; i++)
+    {
+      seed = seed * 1103515245 + 12345;
+      array[seed % ARRAY_SIZE]++;
+    }
+  msg ("touched %d random bytes", ACCESS_CNT);
+
+  for (i = 0; i < ARRAY_SIZE; i++)
+    sum += array[i];
+  if (sum != ACCESS_CNT)
+    fail ("sum is %zu, expected %d", sum, ACCESS_CNT);
+  msg ("sum matches");
+}
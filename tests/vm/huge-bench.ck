@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(huge-bench) begin
+(huge-bench) touched 1048576 random bytes
+(huge-bench) sum matches
+(huge-bench) end
+EOF
+our ($test);
+my ($huge) = map (/^VM: (\d+) 2MB pages mapped /,
+		  read_text_file ("$test.output"));
+fail "missing 2MB page statistics\n" if !defined $huge;
+fail "no 2MB page was mapped\n" if $huge < 1;
+pass;
@@ -0,0 +1,36 @@
+/* Fills two pages with the same bytes and waits for the merge
+   scanner, run with -ksm, to back both with one frame.  Then writes
+   to one of them and checks that the other keeps its contents. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define MAX_POLLS (1 << 24)
+
+static char pages[2][PAGE_SIZE] __attribute__ ((aligned (PAGE_SIZE)));
+
+void
+test_main (void)
+{
+  size_t i;
+
+  memset (pages, 'k', sizeof pages);
+  msg ("filled two identical pages");
+
+  for (i = 0; i < MAX_POLLS; i++)
+    if (get_phys_addr (pages[0]) == get_phys_addr (pages[1]))
+      break;
+  if (i == MAX_POLLS)
+    fail ("pages were not merged");
+  msg ("pages share a frame");
+
+  pages[0][0] = 'x';
+  if (get_phys_addr (pages[0]) == get_phys_addr (pages[1]))
+    fail ("write did not break the sharing");
+  if (pages[1][0] != 'k' || pages[0][1] != 'k')
+    fail ("data changed by the merge");
+  msg ("write gets a private copy");
+}
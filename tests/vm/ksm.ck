@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(ksm) begin
+(ksm) filled two identical pages
+(ksm) pages share a frame
+(ksm) write gets a private copy
+(ksm) end
+EOF
+pass;
@@ -0,0 +1,46 @@
+/* Maps a file with MAP_POPULATE and checks its contents, gives
+   madvise() hints on the mapping, then drops an anonymous buffer
+   with MADV_DONTNEED and checks that it reads back as zeros, while
+   initialized data loaded from the executable keeps its contents. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+#define BUF_PAGES 4
+
+static char buf[BUF_PAGES * 4096] __attribute__ ((aligned (4096)));
+static char data[4096] __attribute__ ((aligned (4096))) = "initialized";
+
+void
+test_main (void)
+{
+  int handle;
+  void *map;
+  size_t i;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (ACTUAL, 4096, MAP_POPULATE, handle, 0)) != MAP_FAILED,
+         "mmap \"sample.txt\" with MAP_POPULATE");
+  CHECK (!memcmp (ACTUAL, sample, strlen (sample)),
+         "compare populated mapping against data");
+  CHECK (madvise (map, 4096, MADV_SEQUENTIAL) == 0, "madvise sequential");
+  CHECK (madvise (map, 4096, MADV_WILLNEED) == 0, "madvise willneed");
+  CHECK (madvise (map, 4096, -1) == -1, "madvise with bad advice fails");
+  munmap (map);
+  close (handle);
+
+  memset (buf, 'x', sizeof buf);
+  CHECK (madvise (buf, sizeof buf, MADV_DONTNEED) == 0, "madvise dontneed");
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != 0)
+      fail ("byte %zu is %d after dontneed", i, buf[i]);
+  msg ("dropped buffer reads as zeros");
+
+  CHECK (madvise (data, sizeof data, MADV_DONTNEED) == 0,
+         "madvise dontneed on initialized data");
+  CHECK (!strcmp (data, "initialized"), "initialized data is kept");
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(madvise) begin
+(madvise) open "sample.txt"
+(madvise) mmap "sample.txt" with MAP_POPULATE
+(madvise) compare populated mapping against data
+(madvise) madvise sequential
+(madvise) madvise willneed
+(madvise) madvise with bad advice fails
+(madvise) madvise dontneed
+(madvise) dropped buffer reads as zeros
+(madvise) madvise dontneed on initialized data
+(madvise) initialized data is kept
+(madvise) end
+EOF
+pass;
@@ -0,0 +1,61 @@
+/* Reads the process's memory counters while it touches anonymous
+   memory and maps a file, then caps its resident set and touches
+   more memory than the cap allows.  The cap must hold, the excess
+   must go to swap, and the data must survive. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define SMALL_PAGES 64
+#define BIG_PAGES 256
+#define CAP_SLACK 32
+#define ACTUAL ((void *) 0x10000000)
+
+static char small[SMALL_PAGES * PAGE_SIZE];
+static char big[BIG_PAGES * PAGE_SIZE];
+
+void
+test_main (void)
+{
+  struct memstat before, st;
+  int handle;
+  void *map;
+  size_t i;
+
+  CHECK (memstat (&before) == 0, "memstat");
+  memset (small, 'a', sizeof small);
+  memstat (&st);
+  if (st.rss < before.rss + SMALL_PAGES)
+    fail ("rss grew from %lu to only %lu", before.rss, st.rss);
+  msg ("rss counts touched pages");
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (ACTUAL, 4096, 0, handle, 0)) != MAP_FAILED,
+         "mmap \"sample.txt\"");
+  memstat (&st);
+  if (st.mmap != before.mmap + 1)
+    fail ("mmap is %lu, expected %lu", st.mmap, before.mmap + 1);
+  msg ("mmap counts the mapping");
+  munmap (map);
+  close (handle);
+
+  CHECK (rsslimit (st.rss + CAP_SLACK) == 0, "rsslimit");
+  for (i = 0; i < BIG_PAGES; i++)
+    memset (big + i * PAGE_SIZE, (char) i, PAGE_SIZE);
+  memstat (&st);
+  if (st.rss > st.rss_limit)
+    fail ("rss %lu is over the cap %lu", st.rss, st.rss_limit);
+  if (st.swap == 0)
+    fail ("nothing was swapped out");
+  msg ("rss stays under the cap");
+
+  for (i = 0; i < BIG_PAGES; i++)
+    if (big[i * PAGE_SIZE] != (char) i
+        || big[i * PAGE_SIZE + PAGE_SIZE - 1] != (char) i)
+      fail ("data is inconsistent in page %zu", i);
+  msg ("data survives");
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(memstat) begin
+(memstat) memstat
+(memstat) rss counts touched pages
+(memstat) open "sample.txt"
+(memstat) mmap "sample.txt"
+(memstat) mmap counts the mapping
+(memstat) rsslimit
+(memstat) rss stays under the cap
+(memstat) data survives
+(memstat) end
+EOF
+pass;
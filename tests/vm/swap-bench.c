@@ -0,0 +1,43 @@
+/* Measures swap throughput.
+ * For this test, Pintos memory size is 8MB.
+ * Fills every byte of a 16MB array with a per-page pattern, which
+ * pushes most of it out to swap, then reads it back in order and
+ * verifies it, which pulls it in again.  The pages/s figures for both
+ * directions are printed with the kernel statistics at shutdown. */
+
+#include <string.h>
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SHIFT 12
+#define PAGE_SIZE (1 << PAGE_SHIFT)
+#define ONE_MB (1 << 20) // 1MB
+#define CHUNK_SIZE (16*ONE_MB)
+#define PAGE_COUNT (CHUNK_SIZE / PAGE_SIZE)
+
+static char big_chunks[CHUNK_SIZE];
+
+void
+test_main (void)
+{
+    size_t i, j;
+    char *mem;
+
+    for (i = 0 ; i < PAGE_COUNT ; i++) {
+        if (!(i % 1024))
+            msg ("swap out: write page %zu", i);
+        mem = big_chunks + i * PAGE_SIZE;
+        memset (mem, (char) (i * 7 + 1), PAGE_SIZE);
+    }
+
+    for (i = 0 ; i < PAGE_COUNT ; i++) {
+        mem = big_chunks + i * PAGE_SIZE;
+        for (j = 0 ; j < PAGE_SIZE ; j += 512)
+            if (mem[j] != (char) (i * 7 + 1))
+                fail ("data is inconsistent in page %zu", i);
+        if (!(i % 1024))
+            msg ("swap in: check page %zu", i);
+    }
+}
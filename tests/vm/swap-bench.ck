@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(swap-bench) begin
+(swap-bench) swap out: write page 0
+(swap-bench) swap out: write page 1024
+(swap-bench) swap out: write page 2048
+(swap-bench) swap out: write page 3072
+(swap-bench) swap in: check page 0
+(swap-bench) swap in: check page 1024
+(swap-bench) swap in: check page 2048
+(swap-bench) swap in: check page 3072
+(swap-bench) end
+EOF
+pass;
@@ -31,11 +31,17 @@
 #include "tests/threads/tests.h"
 #ifdef VM
 #include "vm/vm.h"
+#include "vm/zram.h"
 #endif
 #ifdef FILESYS
 #include "devices/disk.h"
+#include "filesys/buffer_cache.h"
+#include "filesys/dentry.h"
+#include "filesys/directory.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
 #include "filesys/fsutil.h"
+#include "filesys/inode.h"
 #endif
 
 /* Page-map-level-4 with kernel mappings only. */
@@ -140,29 +146,74 @@ bss_init (void) {
 	memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* Returns the number of page-table pages below PML4's kernel
+ * entries, counting PML4 itself. */
+static size_t
+count_kernel_tables (uint64_t *pml4) {
+	size_t cnt = 1;
+
+	for (size_t i = PML4 (KERN_BASE); i < PGSIZE / sizeof (uint64_t); i++) {
+		if (!(pml4[i] & PTE_P))
+			continue;
+		uint64_t *pdpt = ptov (PTE_ADDR (pml4[i]));
+		cnt++;
+		for (size_t j = 0; j < PGSIZE / sizeof (uint64_t); j++) {
+			if (!(pdpt[j] & PTE_P))
+				continue;
+			uint64_t *pd = ptov (PTE_ADDR (pdpt[j]));
+			cnt++;
+			for (size_t k = 0; k < PGSIZE / sizeof (uint64_t); k++)
+				if ((pd[k] & PTE_P) && !(pd[k] & PTE_PS))
+					cnt++;
+		}
+	}
+	return cnt;
+}
+
 /* Populates the page table with the kernel virtual mapping,
  * and then sets up the CPU to use the new page directory.
- * Points base_pml4 to the pml4 it creates. */
+ * Points base_pml4 to the pml4 it creates.
+ * Whole 2MB blocks of physical memory are mapped with 2MB pages.
+ * Only the blocks holding the read-only kernel text, and the partial
+ * block at the end of memory, use 4KB pages. */
 static void
 paging_init (uint64_t mem_end) {
 	uint64_t *pml4, *pte;
 	int perm;
+	size_t huge_cnt = 0;
 	pml4 = base_pml4 = palloc_get_page (PAL_ASSERT | PAL_ZERO);
 
 	extern char start, _end_kernel_text;
 	// Maps physical address [0 ~ mem_end] to
 	//   [LOADER_KERN_BASE ~ LOADER_KERN_BASE + mem_end].
-	for (uint64_t pa = 0; pa < mem_end; pa += PGSIZE) {
+	for (uint64_t pa = 0; pa < mem_end; ) {
 		uint64_t va = (uint64_t) ptov(pa);
 
+		if ((pa & HPGMASK) == 0 && pa + HPGSIZE <= mem_end
+				&& (va + HPGSIZE <= (uint64_t) &start
+					|| va >= (uint64_t) &_end_kernel_text)) {
+			if ((pte = pml4_pde_walk (pml4, va, 1)) != NULL)
+				*pte = pa | PTE_PS | PTE_P | PTE_W;
+			huge_cnt++;
+			pa += HPGSIZE;
+			continue;
+		}
+
 		perm = PTE_P | PTE_W;
 		if ((uint64_t) &start <= va && va < (uint64_t) &_end_kernel_text)
 			perm &= ~PTE_W;
 
 		if ((pte = pml4e_walk (pml4, va, 1)) != NULL)
 			*pte = pa | perm;
+		pa += PGSIZE;
 	}
 
+	/* With 4KB pages only, each 2MB page would need a page table. */
+	size_t tables = count_kernel_tables (pml4);
+	printf ("Kernel direct map: %zu 2MB pages, %zu page-table pages "
+			"(%zu with 4KB pages only)\n",
+			huge_cnt, tables, tables + huge_cnt);
+
 	// reload cr3
 	pml4_activate(0);
 }
@@ -226,6 +277,18 @@ parse_options (char **argv) {
 			user_page_limit = atoi (value);
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
+#endif
+#ifdef VM
+		else if (!strcmp (name, "-vm-low"))
+			vm_low_watermark = atoi (value);
+		else if (!strcmp (name, "-vm-high"))
+			vm_high_watermark = atoi (value);
+		else if (!strcmp (name, "-zram"))
+			zram_cap_pages = atoi (value);
+		else if (!strcmp (name, "-thp"))
+			vm_huge_pages = true;
+		else if (!strcmp (name, "-ksm"))
+			vm_ksm_pages = atoi (value);
 #endif
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
@@ -328,6 +391,13 @@ usage (void) {
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+			"  -vm-low=COUNT      Wake the reclaim daemon below COUNT free frames.\n"
+			"  -vm-high=COUNT     Reclaim until COUNT frames are free.\n"
+			"  -zram=PAGES        Keep compressed swap in up to PAGES kernel pages.\n"
+			"  -thp               Map aligned 2MB blocks with huge pages.\n"
+			"  -ksm=PAGES         Merge identical pages, scanning PAGES per wakeup.\n"
 #endif
 			);
 	power_off ();
@@ -356,10 +426,18 @@ print_stats (void) {
 	thread_print_stats ();
 #ifdef FILESYS
 	disk_print_stats ();
+	buffer_cache_print_stats ();
+	free_map_print_stats ();
+	inode_print_stats ();
+	dir_print_stats ();
+	dentry_print_stats ();
 #endif
 	console_print_stats ();
 	kbd_print_stats ();
 #ifdef USERPROG
 	exception_print_stats ();
 #endif
+#ifdef VM
+	vm_print_stats ();
+#endif
 }
@@ -8,6 +8,28 @@
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+/* Number of 2MB mappings split into page tables. */
+static size_t huge_split_cnt;
+
+/* Replaces the 2MB mapping in *PDE by a page table of 4KB PTEs that
+ * map the same frames with the same flags, so that single pages of
+ * it can be changed.  Returns false if out of memory. */
+static bool
+pde_split(uint64_t *pde)
+{
+	uint64_t *pt = palloc_get_page(0);
+	if (pt == NULL)
+		return false;
+
+	uint64_t pa = PTE_ADDR(*pde);
+	uint64_t flags = *pde & PTE_FLAGS & ~PTE_PS;
+	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+		pt[i] = (pa + i * PGSIZE) | flags;
+	*pde = vtop(pt) | PTE_U | PTE_W | PTE_P;
+	huge_split_cnt++;
+	return true;
+}
+
 static uint64_t *
 pgdir_walk(uint64_t *pdp, const uint64_t va, int create)
 {
@@ -28,6 +50,18 @@ pgdir_walk(uint64_t *pdp, const uint64_t va, int create)
 			else
 				return NULL;
 		}
+		if (pdp[idx] & PTE_PS)
+		{
+			/* A 2MB page.  Its PDE has the same P, W, U, A and D bits as
+			 * a PTE, so lookups get the PDE itself; changing one 4KB
+			 * page of it needs it split.  The old large TLB entry maps
+			 * the same frames, but drop it so new 4KB permissions hold. */
+			if (!create)
+				return &pdp[idx];
+			if (!pde_split(&pdp[idx]))
+				return NULL;
+			invlpg(va);
+		}
 		return (uint64_t *)ptov(PTE_ADDR(pdp[idx]) + 8 * PTX(va));
 	}
 	return NULL;
@@ -73,7 +107,9 @@ pdpe_walk(uint64_t *pdpe, const uint64_t va, int create)
  * If PML4E does not have a page table for VADDR, behavior depends
  * on CREATE.  If CREATE is true, then a new page table is
  * created and a pointer into it is returned.  Otherwise, a null
- * pointer is returned. */
+ * pointer is returned.
+ * If VADDR lies in a 2MB page, CREATE splits it into a page table
+ * first; otherwise the 2MB page's PDE is returned. */
 uint64_t *
 pml4e_walk(uint64_t *pml4e, const uint64_t va, int create)
 {
@@ -109,8 +145,36 @@ pml4e_walk(uint64_t *pml4e, const uint64_t va, int create)
 	return pte;
 }
 
+/* Returns the page directory entry for VA in PML4, creating the
+ * upper levels if CREATE, or a null pointer.  The entry may then be
+ * set to map a 2MB page with PTE_PS. */
+uint64_t *
+pml4_pde_walk(uint64_t *pml4, const uint64_t va, int create)
+{
+	uint64_t *table = pml4;
+	const int idx[2] = {PML4(va), PDPE(va)};
+
+	for (int level = 0; level < 2; level++)
+	{
+		uint64_t *e = &table[idx[level]];
+		if (!(*e & PTE_P))
+		{
+			if (!create)
+				return NULL;
+			uint64_t *new_page = palloc_get_page(PAL_ZERO);
+			if (new_page == NULL)
+				return NULL;
+			*e = vtop(new_page) | PTE_U | PTE_W | PTE_P;
+		}
+		table = ptov(PTE_ADDR(*e));
+	}
+	return &table[PDX(va)];
+}
+
 /* Creates a new page map level 4 (pml4) has mappings for kernel
  * virtual addresses, but none for user virtual addresses.
+ * The kernel entries point at base_pml4's own lower-level tables,
+ * so every process shares the one kernel direct map.
  * Returns the new page directory, or a null pointer if memory
  * allocation fails. */
 uint64_t *
@@ -149,10 +213,20 @@ pgdir_for_each(uint64_t *pdp, pte_for_each_func *func, void *aux,
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
 	{
 		uint64_t *pte = ptov((uint64_t *)pdp[i]);
-		if (((uint64_t)pte) & PTE_P)
-			if (!pt_for_each((uint64_t *)PTE_ADDR(pte), func, aux,
-							 pml4_index, pdp_index, i))
+		if (!(((uint64_t)pte) & PTE_P))
+			continue;
+		/* A 2MB page is visited once, through its PDE. */
+		if (pdp[i] & PTE_PS)
+		{
+			void *va = (void *)(((uint64_t)pml4_index << PML4SHIFT) |
+								((uint64_t)pdp_index << PDPESHIFT) |
+								((uint64_t)i << PDXSHIFT));
+			if (!func(&pdp[i], va, aux))
 				return false;
+		}
+		else if (!pt_for_each((uint64_t *)PTE_ADDR(pte), func, aux,
+							  pml4_index, pdp_index, i))
+			return false;
 	}
 	return true;
 }
@@ -205,7 +279,11 @@ pgdir_destroy(uint64_t *pdp)
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
 	{
 		uint64_t *pte = ptov((uint64_t *)pdp[i]);
-		if (((uint64_t)pte) & PTE_P)
+		if (!(((uint64_t)pte) & PTE_P))
+			continue;
+		if (pdp[i] & PTE_PS)
+			palloc_free_multiple((void *)PTE_ADDR(pte), HPGSIZE / PGSIZE);
+		else
 			pt_destroy(PTE_ADDR(pte));
 	}
 	palloc_free_page((void *)pdp);
@@ -256,7 +334,8 @@ pml4_get_page(uint64_t *pml4, const void *uaddr)
 	uint64_t *pte = pml4e_walk(pml4, (uint64_t)uaddr, 0);
 
 	if (pte && (*pte & PTE_P))
-		return ptov(PTE_ADDR(*pte)) + pg_ofs(uaddr);
+		return ptov(PTE_ADDR(*pte)) +
+			   ((*pte & PTE_PS) ? (uint64_t)uaddr & HPGMASK : pg_ofs(uaddr));
 	return NULL;
 }
 
@@ -282,6 +361,50 @@ bool pml4_set_page(uint64_t *pml4, void *upage, void *kpage, bool rw)
 	return pte != NULL;
 }
 
+/* Maps the 2MB of user virtual memory at UPAGE to the physically
+ * contiguous frames at KPAGE with a single PDE.  Both must be 2MB
+ * aligned, and nothing in the range may be mapped yet.  The mapping
+ * is split into 4KB pages when one of them is changed.
+ * Returns true if successful, false if memory allocation failed. */
+bool pml4_set_huge_page(uint64_t *pml4, void *upage, void *kpage, bool rw)
+{
+	ASSERT(((uint64_t)upage & HPGMASK) == 0);
+	ASSERT((vtop(kpage) & HPGMASK) == 0);
+	ASSERT(is_user_vaddr((uint8_t *)upage + HPGSIZE - 1));
+	ASSERT(pml4 != base_pml4);
+
+	uint64_t *pde = pml4_pde_walk(pml4, (uint64_t)upage, true);
+	if (pde == NULL)
+		return false;
+
+	/* An empty page table may be left from earlier 4KB mappings. */
+	if (*pde & PTE_P)
+	{
+		uint64_t *pt = ptov(PTE_ADDR(*pde));
+		ASSERT(!(*pde & PTE_PS));
+		for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+			ASSERT(!(pt[i] & PTE_P));
+		palloc_free_page(pt);
+	}
+	*pde = vtop(kpage) | PTE_PS | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+	if (rcr3() == vtop(pml4))
+		invlpg((uint64_t)upage);
+	return true;
+}
+
+/* Returns true if UPAGE in PML4 is mapped by a 2MB page. */
+bool pml4_is_huge(uint64_t *pml4, const void *upage)
+{
+	uint64_t *pde = pml4_pde_walk(pml4, (uint64_t)upage, false);
+	return pde != NULL && (*pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS);
+}
+
+/* Returns the number of 2MB pages split into 4KB pages so far. */
+size_t pml4_huge_split_cnt(void)
+{
+	return huge_split_cnt;
+}
+
 /* Marks user virtual page UPAGE "not present" in page
  * directory PD.  Later accesses to the page will fault.  Other
  * bits in the page table entry are preserved.
@@ -293,6 +416,14 @@ void pml4_clear_page(uint64_t *pml4, void *upage)
 	ASSERT(is_user_vaddr(upage));
 
 	pte = pml4e_walk(pml4, (uint64_t)upage, false);
+	if (pte != NULL && (*pte & PTE_PS))
+	{
+		/* The frame behind UPAGE is about to be reused, so leaving
+		 * the 2MB page in place is not an option. */
+		pte = pml4e_walk(pml4, (uint64_t)upage, true);
+		if (pte == NULL)
+			PANIC("Out of memory splitting a 2MB page.");
+	}
 
 	if (pte != NULL && (*pte & PTE_P) != 0)
 	{
@@ -317,6 +448,9 @@ bool pml4_is_dirty(uint64_t *pml4, const void *vpage)
 void pml4_set_dirty(uint64_t *pml4, const void *vpage, bool dirty)
 {
 	uint64_t *pte = pml4e_walk(pml4, (uint64_t)vpage, false);
+	/* Cleaning one page must not clean the rest of a 2MB page. */
+	if (pte != NULL && !dirty && (*pte & PTE_PS))
+		pte = pml4e_walk(pml4, (uint64_t)vpage, true);
 	if (pte)
 	{
 		if (dirty)
@@ -340,7 +474,7 @@ bool pml4_is_accessed(uint64_t *pml4, const void *vpage)
 }
 
 /* Sets the accessed bit to ACCESSED in the PTE for virtual page
-   VPAGE in PD. */
+   VPAGE in PD.  For a 2MB page this is the bit of the whole page. */
 void pml4_set_accessed(uint64_t *pml4, const void *vpage, bool accessed)
 {
 	uint64_t *pte = pml4e_walk(pml4, (uint64_t)vpage, false);
@@ -355,3 +489,245 @@ void pml4_set_accessed(uint64_t *pml4, const void *vpage, bool accessed)
 			invlpg((uint64_t)vpage);
 	}
 }
+
+/* Range operations.
+ * These work on all the user pages in [START, END) at once: each
+ * level of the tables is walked once, and the PTEs of one page table
+ * are handled in a single loop, instead of walking down from the root
+ * for every page.  The TLB is flushed once at the end. */
+
+/* Returns the end of the span of size 1 << SHIFT containing VA,
+ * or END if that comes first. */
+static uint64_t
+span_end(uint64_t va, unsigned shift, uint64_t end)
+{
+	uint64_t next = (va | ((1ULL << shift) - 1)) + 1;
+	return next < end ? next : end;
+}
+
+/* Returns true if [VA, END) covers the whole span of size 1 << SHIFT
+ * starting at VA. */
+static bool
+span_whole(uint64_t va, unsigned shift, uint64_t end)
+{
+	return (va & ((1ULL << shift) - 1)) == 0 && end - va >= (1ULL << shift);
+}
+
+typedef bool pde_range_func(uint64_t *pde, uint64_t va, uint64_t end, void *aux);
+
+/* Calls FUNC for each PDE that maps part of [VA, END) with the part it
+ * maps, skipping the parts that have no page directory.  If
+ * FREE_TABLES, page directories and page directory pointer tables
+ * that lie entirely inside the range are freed afterwards.  Stops and
+ * returns false as soon as FUNC does. */
+static bool
+pde_range_walk(uint64_t *pml4, uint64_t va, uint64_t end,
+			   pde_range_func *func, void *aux, bool free_tables)
+{
+	while (va < end)
+	{
+		uint64_t *pml4e = &pml4[PML4(va)];
+		uint64_t pml4_end = span_end(va, PML4SHIFT, end);
+		bool pml4_whole = span_whole(va, PML4SHIFT, end);
+
+		if (*pml4e & PTE_P)
+		{
+			uint64_t *pdp = ptov(PTE_ADDR(*pml4e));
+			while (va < pml4_end)
+			{
+				uint64_t *pdpe = &pdp[PDPE(va)];
+				uint64_t pdp_end = span_end(va, PDPESHIFT, pml4_end);
+				bool pdp_whole = span_whole(va, PDPESHIFT, end);
+
+				if (*pdpe & PTE_P)
+				{
+					uint64_t *pd = ptov(PTE_ADDR(*pdpe));
+					for (; va < pdp_end; va = span_end(va, PDXSHIFT, pdp_end))
+						if (!func(&pd[PDX(va)], va, span_end(va, PDXSHIFT, pdp_end), aux))
+							return false;
+					if (free_tables && pdp_whole)
+					{
+						*pdpe = 0;
+						palloc_free_page(pd);
+					}
+				}
+				va = pdp_end;
+			}
+			if (free_tables && pml4_whole)
+			{
+				*pml4e = 0;
+				palloc_free_page(pdp);
+			}
+		}
+		va = pml4_end;
+	}
+	return true;
+}
+
+/* What pde_range_update() does to each present entry. */
+struct range_update
+{
+	uint64_t clear;	  /* Flags to clear, or 0 to remove the entry. */
+	bool free_tables; /* Free the page tables inside the range. */
+	bool changed;	  /* Set if any entry was changed. */
+};
+
+/* pde_range_func for the clear, protect and destroy operations.  A 2MB
+ * page the range only partly covers is split first.  Returns false if
+ * that runs out of memory. */
+static bool
+pde_range_update(uint64_t *pde, uint64_t va, uint64_t end, void *aux)
+{
+	struct range_update *ru = aux;
+	bool whole = span_whole(va, PDXSHIFT, end);
+
+	if (!(*pde & PTE_P))
+		return true;
+	if (*pde & PTE_PS)
+	{
+		if (whole)
+		{
+			*pde = ru->clear ? *pde & ~ru->clear : 0;
+			ru->changed = true;
+			return true;
+		}
+		if (!pde_split(pde))
+			return false;
+	}
+
+	uint64_t *pt = ptov(PTE_ADDR(*pde));
+	for (unsigned i = PTX(va); va < end; i++, va += PGSIZE)
+		if (pt[i] & PTE_P)
+		{
+			pt[i] = ru->clear ? pt[i] & ~ru->clear : 0;
+			ru->changed = true;
+		}
+
+	if (ru->free_tables && whole)
+	{
+		*pde = 0;
+		palloc_free_page(pt);
+	}
+	return true;
+}
+
+/* Applies RU to [START, END) of PML4.  Returns false if out of
+ * memory; the entries handled so far stay changed. */
+static bool
+range_update(uint64_t *pml4, void *start, void *end, struct range_update *ru)
+{
+	ASSERT(pg_ofs(start) == 0 && pg_ofs(end) == 0);
+	ASSERT(start <= end && (uint64_t)end <= KERN_BASE);
+	ASSERT(pml4 != base_pml4);
+
+	bool ok = pde_range_walk(pml4, (uint64_t)start, (uint64_t)end,
+							 pde_range_update, ru, ru->free_tables);
+	if ((ru->changed || ru->free_tables) && rcr3() == vtop(pml4))
+		lcr3(rcr3());
+	return ok;
+}
+
+/* Marks every user page in [START, END) of PML4 "not present", like
+ * pml4_clear_page() does for one page.  Other bits in the entries are
+ * preserved. */
+void pml4_clear_range(uint64_t *pml4, void *start, void *end)
+{
+	struct range_update ru = {.clear = PTE_P};
+
+	if (!range_update(pml4, start, end, &ru))
+		PANIC("Out of memory splitting a 2MB page.");
+}
+
+/* Makes every user page in [START, END) of PML4 read-only.
+ * Returns false if out of memory. */
+bool pml4_protect_range(uint64_t *pml4, void *start, void *end)
+{
+	struct range_update ru = {.clear = PTE_W};
+
+	return range_update(pml4, start, end, &ru);
+}
+
+/* Removes every mapping in [START, END) of PML4 and frees the page
+ * tables that lie entirely inside the range.  Unlike pml4_destroy(),
+ * the mapped frames are left alone: they belong to the caller. */
+void pml4_destroy_range(uint64_t *pml4, void *start, void *end)
+{
+	struct range_update ru = {.clear = 0, .free_tables = true};
+
+	if (!range_update(pml4, start, end, &ru))
+		PANIC("Out of memory splitting a 2MB page.");
+}
+
+/* State of pml4_copy_range(). */
+struct range_copy
+{
+	uint64_t *dst;				/* Page map level 4 copied into. */
+	pte_for_each_func *filter;	/* Entries to copy, or a null pointer. */
+	void *aux;					/* Passed to FILTER. */
+};
+
+/* pde_range_func for pml4_copy_range().  The page table of DST is
+ * only looked up, or created, once an entry is actually copied. */
+static bool
+pde_range_copy(uint64_t *pde, uint64_t va, uint64_t end, void *aux)
+{
+	struct range_copy *rc = aux;
+	uint64_t *dst_pt = NULL;
+
+	if (!(*pde & PTE_P))
+		return true;
+
+	for (; va < end; va += PGSIZE)
+	{
+		uint64_t pte;
+		if (*pde & PTE_PS)
+			pte = (PTE_ADDR(*pde) + (va & HPGMASK)) | (*pde & PTE_FLAGS & ~PTE_PS);
+		else
+			pte = ((uint64_t *)ptov(PTE_ADDR(*pde)))[PTX(va)];
+
+		if (!(pte & PTE_P))
+			continue;
+		if (rc->filter != NULL && !rc->filter(&pte, (void *)va, rc->aux))
+			continue;
+
+		if (dst_pt == NULL)
+		{
+			uint64_t *dst_pde = pml4_pde_walk(rc->dst, va, true);
+			if (dst_pde == NULL)
+				return false;
+			if (!(*dst_pde & PTE_P))
+			{
+				uint64_t *new_page = palloc_get_page(PAL_ZERO);
+				if (new_page == NULL)
+					return false;
+				*dst_pde = vtop(new_page) | PTE_U | PTE_W | PTE_P;
+			}
+			ASSERT(!(*dst_pde & PTE_PS));
+			dst_pt = ptov(PTE_ADDR(*dst_pde));
+		}
+		dst_pt[PTX(va)] = pte & ~(PTE_W | PTE_A | PTE_D);
+	}
+	return true;
+}
+
+/* Maps into DST, read-only, the frames that SRC maps in [START, END),
+ * at the same addresses.  Only the entries FILTER returns true for are
+ * copied, or all of them if FILTER is a null pointer; FILTER gets a
+ * copy of each entry, so it must not change it.  A 2MB page of SRC is
+ * copied as 4KB pages.  Use pml4_protect_range() on SRC as well to
+ * share the frames copy-on-write.
+ * Returns false if out of memory. */
+bool pml4_copy_range(uint64_t *dst, uint64_t *src, void *start, void *end,
+					 pte_for_each_func *filter, void *aux)
+{
+	struct range_copy rc = {.dst = dst, .filter = filter, .aux = aux};
+
+	ASSERT(pg_ofs(start) == 0 && pg_ofs(end) == 0);
+	ASSERT(start <= end && (uint64_t)end <= KERN_BASE);
+	ASSERT(dst != base_pml4);
+
+	/* Entries only go from not present to present, so DST's TLB
+	 * needs no flush. */
+	return pde_range_walk(src, (uint64_t)start, (uint64_t)end,
+						  pde_range_copy, &rc, false);
+}
@@ -284,6 +284,39 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	return pages;
 }
 
+/* Like palloc_get_multiple(), but the first page's physical
+   address is a multiple of ALIGN_CNT pages, as a 2MB page mapping
+   needs.  Returns a null pointer if no such run is free. */
+void *
+palloc_get_aligned (enum palloc_flags flags, size_t page_cnt,
+		size_t align_cnt) {
+	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	size_t pool_cnt = bitmap_size (pool->used_map);
+	size_t first, page_idx = BITMAP_ERROR;
+
+	ASSERT (align_cnt > 0);
+	first = (align_cnt - pg_no (vtop (pool->base)) % align_cnt) % align_cnt;
+	lock_acquire (&pool->lock);
+	for (size_t i = first; i + page_cnt <= pool_cnt; i += align_cnt)
+		if (bitmap_none (pool->used_map, i, page_cnt)) {
+			bitmap_set_multiple (pool->used_map, i, page_cnt, true);
+			page_idx = i;
+			break;
+		}
+	lock_release (&pool->lock);
+
+	if (page_idx == BITMAP_ERROR) {
+		if (flags & PAL_ASSERT)
+			PANIC ("palloc_get: out of pages");
+		return NULL;
+	}
+
+	void *pages = pool->base + PGSIZE * page_idx;
+	if (flags & PAL_ZERO)
+		memset (pages, 0, PGSIZE * page_cnt);
+	return pages;
+}
+
 /* Obtains a single free page and returns its kernel virtual
    address.
    If PAL_USER is set, the page is obtained from the user pool,
@@ -328,6 +361,16 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
+/* Returns the number of pages currently free in the user pool. */
+size_t
+palloc_user_free_pages (void) {
+	lock_acquire (&user_pool.lock);
+	size_t cnt = bitmap_count (user_pool.used_map, 0,
+			bitmap_size (user_pool.used_map), false);
+	lock_release (&user_pool.lock);
+	return cnt;
+}
+
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
@@ -353,6 +353,91 @@ void cond_broadcast(struct condition *cond, struct lock *lock)
 		cond_signal(cond, lock);
 }
 
+/* Initializes RWLOCK.  A readers-writer lock lets any number of
+   readers hold it at once, or a single writer.  A writer that is
+   waiting keeps new readers out, so a stream of readers cannot
+   starve it.  Like a lock, it must be released by the thread that
+   acquired it, and it may not be acquired recursively. */
+void rwlock_init(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+
+	lock_init(&rw->lock);
+	cond_init(&rw->readers_ok);
+	cond_init(&rw->writers_ok);
+	rw->readers = 0;
+	rw->waiting_writers = 0;
+	rw->writer = NULL;
+}
+
+/* Acquires RW for reading, sleeping while a writer holds it or
+   waits for it. */
+void rwlock_acquire_read(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+	ASSERT(!intr_context());
+	ASSERT(rw->writer != thread_current());
+
+	lock_acquire(&rw->lock);
+	while (rw->writer != NULL || rw->waiting_writers > 0)
+		cond_wait(&rw->readers_ok, &rw->lock);
+	rw->readers++;
+	lock_release(&rw->lock);
+}
+
+/* Releases RW, held for reading. */
+void rwlock_release_read(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+
+	lock_acquire(&rw->lock);
+	ASSERT(rw->readers > 0);
+	if (--rw->readers == 0)
+		cond_signal(&rw->writers_ok, &rw->lock);
+	lock_release(&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until no one else holds it. */
+void rwlock_acquire_write(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+	ASSERT(!intr_context());
+	ASSERT(rw->writer != thread_current());
+
+	lock_acquire(&rw->lock);
+	rw->waiting_writers++;
+	while (rw->writer != NULL || rw->readers > 0)
+		cond_wait(&rw->writers_ok, &rw->lock);
+	rw->waiting_writers--;
+	rw->writer = thread_current();
+	lock_release(&rw->lock);
+}
+
+/* Releases RW, held for writing by the current thread.  Waiting
+   writers go first; readers are let in once there are none. */
+void rwlock_release_write(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+	ASSERT(rwlock_held_by_current_thread(rw));
+
+	lock_acquire(&rw->lock);
+	rw->writer = NULL;
+	if (rw->waiting_writers > 0)
+		cond_signal(&rw->writers_ok, &rw->lock);
+	else
+		cond_broadcast(&rw->readers_ok, &rw->lock);
+	lock_release(&rw->lock);
+}
+
+/* Returns true if the current thread holds RW for writing, false
+   otherwise. */
+bool rwlock_held_by_current_thread(const struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+
+	return rw->writer == thread_current();
+}
+
 // 두 sema 안의 'waiters list 안의 스레드 중 제일 높은 priority'를 비교해서 높으면 true를 반환하는 함수
 bool cmp_sema_priority(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED)
 {
@@ -203,9 +203,7 @@ __do_fork(void *aux)
 	}
 	current->next_fd = parent->next_fd;
 
-	lock_acquire(&filesys_lock);
 	sema_up(&current->load_sema);
-	lock_release(&filesys_lock);
 	process_init();
 
 	/* Finally, switch to the newly created process. */
@@ -242,9 +240,7 @@ int process_exec(void *f_name)
 		parse[count++] = token;
 
 	/* And then load the binary */
-	lock_acquire(&filesys_lock);
 	success = load(file_name, &_if);
-	lock_release(&filesys_lock);
 
 	/* If load failed, quit. */
 	if (!success)
@@ -351,9 +347,11 @@ void process_exit(void)
 			close(i);
 	}
 	palloc_free_multiple(cur->fdt, FDT_PAGES);
-	file_close(cur->running); // 현재 실행 중인 파일도 닫는다.
 
+	/* 공유 코드 페이지가 실행 파일의 inode로 색인되어 있으므로
+	 * 페이지를 모두 정리한 뒤에 실행 파일을 닫는다. */
 	process_cleanup();
+	file_close(cur->running); // 현재 실행 중인 파일도 닫는다.
 	// hash_destroy(&cur->spt.spt_hash, NULL); // todo 🚨
 
 	// 자식이 종료될 때까지 대기하고 있는 부모에게 signal을 보낸다.
@@ -795,6 +793,19 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
 		size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+		/* 읽기 전용 세그먼트는 같은 실행 파일을 실행 중인 프로세스끼리 프레임을 공유 */
+		enum vm_type type = writable ? VM_ANON : VM_ANON | VM_MARKER_1;
+
+		/* A page with nothing to read (.bss) is plain zero-fill memory,
+		 * like the stack: no loader, so MADV_DONTNEED may discard it. */
+		if (page_read_bytes == 0) {
+			if (!vm_alloc_page (type, upage, writable))
+				return false;
+			zero_bytes -= page_zero_bytes;
+			upage += PGSIZE;
+			continue;
+		}
+
 		/* TODO: Set up aux to pass information to the lazy_load_segment. */
         struct file_meta_data *meta = malloc(sizeof(struct file_meta_data));
 		if (meta == NULL)
@@ -806,7 +817,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
         meta->ofs = ofs;
 
 		// 왜 VM_ANON?
-		if (!vm_alloc_page_with_initializer (VM_ANON, upage, writable, lazy_load_segment, meta)) {
+		if (!vm_alloc_page_with_initializer (type, upage, writable, lazy_load_segment, meta)) {
 			free(meta);
 			return false;
 		} 
@@ -35,6 +35,10 @@ int exec(const char *cmd_line);
 int wait(int pid);
 void *mmap(void *addr, size_t length, int writable, int fd, off_t offset);
 void munmap (void *addr);
+int msync (void *addr, size_t length);
+int madvise (void *addr, size_t length, int advice);
+int memstat (struct memstat *st);
+size_t rsslimit (size_t pages);
 
 
 /* System call.
@@ -61,7 +65,6 @@ void syscall_init(void)
 	 * mode stack. Therefore, we masked the FLAG_FL. */
 	write_msr(MSR_SYSCALL_MASK,
 			  FLAG_IF | FLAG_TF | FLAG_DF | FLAG_IOPL | FLAG_AC | FLAG_NT);
-	lock_init(&filesys_lock);
 }
 
 /* The main system call interface */
@@ -120,6 +123,18 @@ void syscall_handler(struct intr_frame *f UNUSED)
 	case SYS_MUNMAP:
 		munmap(f->R.rdi);
 		break;
+	case SYS_MSYNC:
+		f->R.rax = msync(f->R.rdi, f->R.rsi);
+		break;
+	case SYS_MADVISE:
+		f->R.rax = madvise(f->R.rdi, f->R.rsi, f->R.rdx);
+		break;
+	case SYS_MEMSTAT:
+		f->R.rax = memstat(f->R.rdi);
+		break;
+	case SYS_RSSLIMIT:
+		f->R.rax = rsslimit(f->R.rdi);
+		break;
     }
 
 }
@@ -148,10 +163,7 @@ void exit(int status)
 bool create(const char *file, unsigned initial_size)
 {
 	check_address(file);
-	lock_acquire(&filesys_lock);
-	bool success = filesys_create(file, initial_size);
-	lock_release(&filesys_lock);
-	return success;
+	return filesys_create(file, initial_size);
 }
 
 bool remove(const char *file)
@@ -163,17 +175,13 @@ bool remove(const char *file)
 int open(const char *file_name)
 {
 	check_address(file_name);
-	lock_acquire(&filesys_lock);
 	struct file *file = filesys_open(file_name);
-	if (file == NULL) {
-		lock_release(&filesys_lock);
+	if (file == NULL)
 		return -1;
-	}
 	int fd = process_add_file(file);
 	if (fd == -1)
 		file_close(file);
 
-	lock_release(&filesys_lock);
 	return fd;
 }
 
@@ -243,9 +251,7 @@ int read(int fd, void *buffer, unsigned size)
 		{
 			return -1;
 		}
-		lock_acquire(&filesys_lock);
 		bytes_read = file_read(file, buffer, size);
-		lock_release(&filesys_lock);
 	}
 	return bytes_read;
 }
@@ -266,10 +272,8 @@ int write(int fd, const void *buffer, unsigned size)
 		struct file *file = process_get_file(fd);
 		if (file == NULL)
 			return -1;
-			
-		lock_acquire(&filesys_lock);
+
 		bytes_write = file_write(file, buffer, size);
-		lock_release(&filesys_lock);
 	}
 	return bytes_write;
 }
@@ -328,7 +332,12 @@ void *mmap(void *addr, size_t length, int writable, int fd, off_t offset)
 		return NULL;
 	}
 
-    return do_mmap(addr, length, writable, file, offset);
+    /* MAP_POPULATE: 매핑 직후 전 범위를 한 번에 fault-in */
+    bool populate = (writable & MAP_POPULATE) != 0;
+    void *ret = do_mmap(addr, length, writable & ~MAP_POPULATE, file, offset);
+    if (ret != NULL && populate)
+        vm_populate(ret, length, true);
+    return ret;
 }
 
 void munmap (void *addr) 
@@ -336,4 +345,53 @@ void munmap (void *addr)
     do_munmap(addr);
 }
 
+/* 매핑의 변경된 페이지를 즉시 파일에 기록. 성공 시 0, 실패 시 -1 */
+int msync (void *addr, size_t length)
+{
+    if (addr == NULL || !is_user_vaddr(addr) || !is_user_vaddr(addr + length))
+        return -1;
+
+    return do_msync(addr, length) ? 0 : -1;
+}
+
+/* ADDR부터 LENGTH 바이트 범위에 대한 사용 패턴 힌트. 성공 시 0, 실패 시 -1 */
+int madvise (void *addr, size_t length, int advice)
+{
+    if (addr == NULL || pg_round_down(addr) != addr || !is_user_vaddr(addr)
+            || !is_user_vaddr(addr + length))
+        return -1;
+
+    return vm_madvise(addr, length, advice) ? 0 : -1;
+}
+
+/* 현재 프로세스의 메모리 카운터를 ST에 복사. 성공 시 0 */
+int memstat (struct memstat *st)
+{
+    struct supplemental_page_table *spt = &thread_current()->spt;
+    void *last = (uint8_t *)st + sizeof *st - 1;
+
+    check_address(st);
+    check_address(last);
+
+    /* ST가 두 페이지에 걸칠 수 있으므로 양 끝 페이지 모두 쓰기 가능해야 함 */
+    struct page *first_page = spt_find_page(spt, st);
+    struct page *last_page = spt_find_page(spt, last);
+    if ((first_page && !first_page->writable) || (last_page && !last_page->writable))
+        exit(-1);
+
+    st->rss = spt->rss_cnt;
+    st->swap = spt->swap_cnt;
+    st->mmap = spt->mmap_cnt;
+    st->rss_limit = spt->rss_limit;
+    return 0;
+}
 
+/* 상주 페이지 수 상한을 PAGES로 설정 (0이면 해제). 이전 상한을 반환 */
+size_t rsslimit (size_t pages)
+{
+    struct supplemental_page_table *spt = &thread_current()->spt;
+    size_t old = spt->rss_limit;
+
+    spt->rss_limit = pages;
+    return old;
+}
@@ -1,8 +1,14 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
+#include <stdio.h>
+#include <string.h>
 #include "vm/vm.h"
+#include "vm/zram.h"
 #include "devices/disk.h"
 #include "threads/vaddr.h"
+#include "threads/synch.h"
+#include "threads/malloc.h"
+#include "devices/timer.h"
 #include "lib/kernel/bitmap.h"
 
 /* DO NOT MODIFY BELOW LINE */
@@ -20,6 +26,16 @@ static const struct page_operations anon_ops = {
 };
 
 struct bitmap *swap_table;
+static uint16_t *swap_ref;		/* Pages referring to each slot. */
+static size_t swap_hint;		/* Next-fit cursor for slot allocation. */
+static struct lock swap_lock;
+
+/* Statistics. */
+static long long swap_out_cnt;	/* # of pages written to swap. */
+static long long swap_out_ticks; /* # of timer ticks spent writing. */
+static long long swap_in_cnt;	/* # of pages read from swap. */
+static long long swap_in_ticks;	/* # of timer ticks spent reading. */
+static long long zram_in_cnt;	/* # of pages read from the RAM tier. */
 const size_t SECTORS_PER_PAGE = PGSIZE / DISK_SECTOR_SIZE;
 
 /* Initialize the data for anonymous pages */
@@ -34,15 +50,103 @@ void vm_anon_init(void)
 	/* 스왑 테이블을 초기화하여 각 페이지의 스왑 슬롯 상태 추적 
 		(모든 bit들을 false로 초기화, 사용 시 true) */
 	swap_table = bitmap_create(swap_size); 
+	/* fork 후 같은 슬롯을 여러 페이지가 공유할 수 있으므로 참조 수를 관리 */
+	swap_ref = calloc(swap_size, sizeof *swap_ref);
+	if (swap_table == NULL || (swap_size > 0 && swap_ref == NULL))
+		PANIC("Failed to allocate the swap table.");
+	lock_init(&swap_lock);
+	zram_init();
+}
+
+/* Allocates CNT contiguous swap slots and returns the first, or
+ * BITMAP_ERROR.  The search continues where the last one ended, so
+ * pages evicted one after another land next to each other on disk. */
+static size_t
+swap_slot_alloc(size_t cnt)
+{
+	lock_acquire(&swap_lock);
+	size_t slot = bitmap_scan_and_flip(swap_table, swap_hint, cnt, false);
+	if (slot == BITMAP_ERROR && swap_hint != 0)
+		slot = bitmap_scan_and_flip(swap_table, 0, cnt, false);
+	if (slot != BITMAP_ERROR)
+	{
+		for (size_t i = 0; i < cnt; i++)
+			swap_ref[slot + i] = 1;
+		swap_hint = slot + cnt;
+	}
+	lock_release(&swap_lock);
+	return slot;
+}
+
+/* Drops one reference to swap slot SLOT, freeing it with the last. */
+static void
+swap_slot_put(size_t slot)
+{
+	lock_acquire(&swap_lock);
+	ASSERT(swap_ref[slot] > 0);
+	if (--swap_ref[slot] == 0)
+		bitmap_reset(swap_table, slot);
+	lock_release(&swap_lock);
+}
+
+/* Reads swap slot SLOT into the page at KVA. */
+static void
+swap_read_slot(size_t slot, void *kva)
+{
+	int64_t start = timer_ticks();
+	disk_read_sectors(swap_disk, slot * SECTORS_PER_PAGE, SECTORS_PER_PAGE, kva);
+	swap_in_ticks += timer_elapsed(start);
+	swap_in_cnt++;
+}
+
+/* Writes the page at KVA into swap slot SLOT. */
+static void
+swap_write_slot(size_t slot, const void *kva)
+{
+	int64_t start = timer_ticks();
+	disk_write_sectors(swap_disk, slot * SECTORS_PER_PAGE, SECTORS_PER_PAGE, kva);
+	swap_out_ticks += timer_elapsed(start);
+	swap_out_cnt++;
+}
+
+/* Prints swap statistics. */
+void anon_print_stats(void)
+{
+	long long in_cnt = swap_in_cnt + zram_in_cnt;
+
+	printf("Swap: %lld pages out in %lld ticks (%lld pages/s), "
+		   "%lld pages in in %lld ticks (%lld pages/s)\n",
+		   swap_out_cnt, swap_out_ticks,
+		   swap_out_ticks ? swap_out_cnt * TIMER_FREQ / swap_out_ticks : 0,
+		   swap_in_cnt, swap_in_ticks,
+		   swap_in_ticks ? swap_in_cnt * TIMER_FREQ / swap_in_ticks : 0);
+	printf("Swap: %lld bytes written to disk, %lld of %lld swap-ins "
+		   "served from RAM (%lld%%)\n",
+		   swap_out_cnt * PGSIZE, zram_in_cnt, in_cnt,
+		   in_cnt ? zram_in_cnt * 100 / in_cnt : 0);
+	zram_print_stats();
 }
 
 /* Initialize the file mapping */
 bool anon_initializer(struct page *page, enum vm_type type, void *kva)
 {
+	/* page->anon을 채우면 같은 자리의 page->uninit이 덮어써지므로 먼저 확인 */
+	bool zero_fill = VM_TYPE(page->operations->type) != VM_UNINIT
+					 || page->uninit.init == NULL;
+
 	/* Set up the handler */
 	page->operations = &anon_ops;
 
 	struct anon_page *anon_page = &page->anon;
+	anon_page->swap_slot_no = -1;
+	anon_page->zobj = NULL;
+	anon_page->zero_fill = zero_fill;
+	anon_page->discarded = false;
+
+	/* 프레임은 이전에 축출된 페이지의 내용을 담고 있을 수 있음 */
+	if (kva != NULL)
+		memset(kva, 0, PGSIZE);
+	return true;
 }
 
 /* Swap in the page by read contents from the swap disk. */
@@ -51,52 +155,193 @@ anon_swap_in(struct page *page, void *kva)
 {
 	struct anon_page *anon_page = &page->anon;
 
+	/* 압축된 사본이 메모리에 있다면 디스크를 거치지 않음 */
+	if (anon_page->zobj != NULL)
+	{
+		zram_load(anon_page->zobj, kva);
+		zram_put(anon_page->zobj);
+		anon_page->zobj = NULL;
+		zram_in_cnt++;
+		vm_account(&page->owner->spt.swap_cnt, -1);
+		return true;
+	}
+
+	/* MADV_DONTNEED로 버려진 페이지는 0으로 채워서 돌려줌 */
+	if (anon_page->discarded)
+	{
+		memset(kva, 0, PGSIZE);
+		anon_page->discarded = false;
+		return true;
+	}
+
 	int page_no = anon_page->swap_slot_no;
 
+	/* 스왑 슬롯도 압축 사본도 없으면 내용을 잃어버린 것 */
+	if (page_no < 0)
+		return false;
+
 	/* 해당 슬롯이 사용 중인지 확인, 사용 중이 아니라면 false 반환 */
 	if (bitmap_test(swap_table, page_no) == false) 
 		return false;
 
-	/* 섹터 순회 */
-	for (int i=0; i < SECTORS_PER_PAGE; ++i) {
-		/* 스왑 디스크에서 섹터 데이터를 읽어와 메모리에 복사 */
-		disk_read(swap_disk, page_no * SECTORS_PER_PAGE + i, kva + DISK_SECTOR_SIZE * i);
-	}
+	/* 스왑 디스크에서 섹터 데이터를 읽어와 메모리에 복사 */
+	swap_read_slot(page_no, kva);
 
-	/* 스왑 슬롯을 사용 가능한 상태로 업데이트 (false) */
-	bitmap_set(swap_table, page_no, false);
+	/* 슬롯 참조를 반납, 마지막 참조였다면 사용 가능한 상태로 (false) */
+	swap_slot_put(page_no);
+	anon_page->swap_slot_no = -1;
+	vm_account(&page->owner->spt.swap_cnt, -1);
 
 	return true;
 }
 
-/* Swap out the page by writing contents to the swap disk. */
+/* Writes the page to a single slot of the swap disk, skipping the RAM
+ * tier. */
 static bool
-anon_swap_out(struct page *page)
+anon_swap_out_disk(struct page *page)
 {
 	struct anon_page *anon_page = &page->anon;
 
-	/* 사용 가능한 스왑 슬롯 검색 */
-	int page_no = bitmap_scan(swap_table, 0, 1, false);
+	/* 사용 가능한 스왑 슬롯 검색 후 사용 중인 상태로 업데이트 (true) */
+	size_t page_no = swap_slot_alloc(1);
 	/* 사용 가능한 슬롯이 없으면 BITMAP_ERROR 반환 */
 	if (page_no == BITMAP_ERROR) 
 		return false;
 	
-	/* 섹터 순회 */
-	for (int i=0; i < SECTORS_PER_PAGE; ++i) {
-		/* 페이지의 섹터 데이터를 스왑 디스크에 복사 */
-		disk_write(swap_disk, page_no * SECTORS_PER_PAGE + i, page->va + DISK_SECTOR_SIZE * i);
-	}
+	/* 페이지의 섹터 데이터를 스왑 디스크에 복사
+	 * (소유자가 다른 프로세스일 수 있으므로 va 대신 kva 사용) */
+	swap_write_slot(page_no, page->frame->kva);
 
-	/* 스왑 슬롯을 사용 중인 상태로 업데이트 (true) */
-	bitmap_set(swap_table, page_no, true);
 	anon_page->swap_slot_no = page_no;
+	vm_account(&page->owner->spt.swap_cnt, 1);
 
 	return true;
 }
 
+/* Swap out the page by writing contents to the swap disk. */
+static bool
+anon_swap_out(struct page *page)
+{
+	struct anon_page *anon_page = &page->anon;
+
+	/* 먼저 압축해서 메모리 계층에 보관 시도 */
+	anon_page->zobj = zram_store(page->frame->kva);
+	if (anon_page->zobj != NULL)
+	{
+		vm_account(&page->owner->spt.swap_cnt, 1);
+		return true;
+	}
+	return anon_swap_out_disk(page);
+}
+
+/* Swaps out CNT resident anonymous PAGES.  Pages the RAM tier takes
+ * stay in memory; the rest go to CNT contiguous swap slots, so a
+ * reclaim batch reaches the disk as one sequential run, or to single
+ * slots if no run that long is free.  Reorders PAGES.  Returns true if
+ * every page was swapped out; anon_is_swapped() tells which were. */
+bool
+anon_swap_out_cluster(struct page **pages, size_t cnt)
+{
+	size_t disk_cnt = 0;
+
+	/* Move the pages the RAM tier refuses to the front. */
+	for (size_t i = 0; i < cnt; i++)
+	{
+		struct page *page = pages[i];
+		ASSERT(page_get_type(page) == VM_ANON);
+		page->anon.zobj = zram_store(page->frame->kva);
+		if (page->anon.zobj == NULL)
+		{
+			pages[i] = pages[disk_cnt];
+			pages[disk_cnt++] = page;
+		}
+		else
+			vm_account(&page->owner->spt.swap_cnt, 1);
+	}
+	if (disk_cnt == 0)
+		return true;
+
+	/* The RAM tier has refused these already, so single slots are
+	 * the only fallback. */
+	size_t slot = swap_slot_alloc(disk_cnt);
+	if (slot == BITMAP_ERROR)
+	{
+		bool ok = true;
+		for (size_t i = 0; i < disk_cnt; i++)
+			ok = anon_swap_out_disk(pages[i]) && ok;
+		return ok;
+	}
+
+	for (size_t i = 0; i < disk_cnt; i++)
+	{
+		swap_write_slot(slot + i, pages[i]->frame->kva);
+		pages[i]->anon.swap_slot_no = slot + i;
+		vm_account(&pages[i]->owner->spt.swap_cnt, 1);
+	}
+	return true;
+}
+
+/* Returns true if anonymous PAGE has a copy in swap, in RAM or on
+ * disk. */
+bool
+anon_is_swapped(struct page *page)
+{
+	return page->anon.zobj != NULL || page->anon.swap_slot_no >= 0;
+}
+
+/* Makes anonymous page DST refer to the swap slot SRC was written to,
+ * as when a frame shared copy-on-write is evicted.  Each page reads the
+ * slot back on its own; the slot is freed after the last one. */
+void
+anon_swap_share(struct page *dst, struct page *src)
+{
+	int slot = src->anon.swap_slot_no;
+
+	if (src->anon.zobj != NULL)
+	{
+		zram_get(src->anon.zobj);
+		dst->anon.zobj = src->anon.zobj;
+		vm_account(&dst->owner->spt.swap_cnt, 1);
+		return;
+	}
+
+	ASSERT(slot >= 0);
+	lock_acquire(&swap_lock);
+	swap_ref[slot]++;
+	lock_release(&swap_lock);
+	dst->anon.swap_slot_no = slot;
+	vm_account(&dst->owner->spt.swap_cnt, 1);
+}
+
+/* Throws away PAGE's contents: its frame, its compressed copy and its
+ * swap slot.  The page stays in the SPT, marked discarded, and reads
+ * back as zeros.  Must be called with frame_lock held. */
+void
+anon_discard(struct page *page)
+{
+	struct anon_page *anon_page = &page->anon;
+
+	if (anon_is_swapped(page))
+		vm_account(&page->owner->spt.swap_cnt, -1);
+
+	/* 스왑 아웃된 페이지라면 스왑 슬롯 반환 */
+	if (anon_page->zobj != NULL)
+	{
+		zram_put(anon_page->zobj);
+		anon_page->zobj = NULL;
+	}
+	if (anon_page->swap_slot_no >= 0)
+	{
+		swap_slot_put(anon_page->swap_slot_no);
+		anon_page->swap_slot_no = -1;
+	}
+	vm_free_frame(page);
+	anon_page->discarded = true;
+}
+
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy(struct page *page)
 {
-	struct anon_page *anon_page = &page->anon;
+	anon_discard(page);
 }
@@ -1,10 +1,15 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
+#include <stdio.h>
 #include <string.h>
 #include "vm/vm.h"
 #include "userprog/process.h"
 #include "threads/mmu.h"
 
+/* Statistics. */
+static long long evict_write_cnt;   /* # of dirty pages written on eviction. */
+static long long unmap_write_cnt;   /* # of dirty pages left at munmap/exit. */
+
 static bool file_backed_swap_in (struct page *page, void *kva);
 static bool file_backed_swap_out (struct page *page);
 static void file_backed_destroy (struct page *page);
@@ -22,6 +27,40 @@ void
 vm_file_init (void) {
 }
 
+/* Prints file-backed page statistics. */
+void
+file_backed_print_stats (void) {
+    printf ("VM: %lld dirty file pages written on eviction, %lld left to the page cache at munmap/exit\n",
+            evict_write_cnt, unmap_write_cnt);
+}
+
+/* Marks PAGE clean if it is resident and dirty, passing the dirty bit
+ * on to the page cache page whose frame it maps, which the page cache
+ * writes back later without the frame lock.  A frame outside the page
+ * cache is written back to the file at once.  The caller must hold the
+ * frame lock.  Returns true if the page was dirty. */
+bool
+file_backed_writeback (struct page *page) {
+    struct file_page *file_page = &page->file;
+    uint64_t *pml4 = page->owner->pml4;
+
+    if (page->frame == NULL || pml4 == NULL || !pml4_is_dirty(pml4, page->va))
+        return false;
+
+    /* 기록 전에 dirty 비트를 지워야 기록 도중의 쓰기가 다음 기록에 반영됨 */
+    pml4_set_dirty(pml4, page->va, false);
+
+    /* 페이지 캐시의 프레임을 공유 중이면 캐시 페이지를 통해 기록 */
+    struct page *cache = page->frame->page;
+    if (VM_TYPE(cache->operations->type) == VM_PAGE_CACHE) {
+        cache->page_cache.dirty = true;
+        return true;
+    }
+
+    file_write_at(file_page->file, page->frame->kva, file_page->page_read_bytes, file_page->ofs);
+    return true;
+}
+
 /* Initialize the file backed page */
 /**
  * 파일 지원 페이지를 초기화합니다. 
@@ -39,6 +78,7 @@ file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
     file_page->ofs = meta->ofs;
     file_page->page_read_bytes = meta->page_read_bytes;
     file_page->page_zero_bytes = meta->page_zero_bytes;
+    return true;
 }
 
 /* Swap in the page by read contents from the file. */
@@ -50,19 +90,12 @@ file_backed_swap_in (struct page *page, void *kva) {
         return false;
     }
 
-    struct file_meta_data *aux = (struct file_meta_data*) page->uninit.aux;
-
-    struct file *file = aux->file;
-    off_t ofs = aux->ofs;
-    size_t page_read_bytes = aux->page_read_bytes;
-    size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-    file_seek(file, ofs);
-
-    if (file_read(file, kva, page_read_bytes) != (int) page_read_bytes)
+    /* uninit.aux는 file_page와 union을 공유하므로 file_page의 값을 사용 */
+    if (file_read_at(file_page->file, kva, file_page->page_read_bytes, file_page->ofs)
+            != (int) file_page->page_read_bytes)
         return false;
 
-    memset(kva + page_read_bytes, 0, page_zero_bytes);
+    memset(kva + file_page->page_read_bytes, 0, file_page->page_zero_bytes);
 
     return true;
 }
@@ -76,15 +109,15 @@ file_backed_swap_out (struct page *page) {
         return false;
     }
 
-    struct file_meta_data *aux = (struct file_meta_data *) page->uninit.aux;
-
-    if (pml4_is_dirty(thread_current()->pml4, page->va)){
-        file_write_at(aux->file, page->va, aux->page_read_bytes, aux->ofs);
-        pml4_set_dirty(thread_current()->pml4, page->va, 0);
+    /* 축출은 다른 프로세스의 페이지에도 일어나므로 소유자의 pml4를 사용 */
+    if (file_backed_writeback(page)) {
+        struct page *cache = page->frame->page;
+        if (VM_TYPE(cache->operations->type) == VM_PAGE_CACHE)
+            page_cache_write_back(cache);
+        evict_write_cnt++;
     }
 
-    pml4_clear_page(thread_current()->pml4, page->va);
-
+    return true;
 }
 
 /* Destory the file backed page. PAGE will be freed by the caller. */
@@ -92,12 +125,10 @@ static void
 file_backed_destroy (struct page *page) {
 	struct file_page *file_page UNUSED = &page->file;
 
-    if (pml4_is_dirty(thread_current()->pml4, page->va))
-    {
-        file_write_at(file_page->file, page->va, file_page->page_read_bytes, file_page->ofs);
-        pml4_set_dirty(thread_current()->pml4, page->va, 0);
-    }
-    pml4_clear_page(thread_current()->pml4, page->va);
+    /* 기록은 페이지 캐시가 frame_lock 없이 나중에 처리 */
+    if (file_backed_writeback(page))
+        unmap_write_cnt++;
+    vm_free_frame(page);
 }
 
 /* Do the mmap */
@@ -137,10 +168,24 @@ do_mmap (void *addr, size_t length, int writable,
         offset += page_read_bytes;
     }
 
+    /* 쓰기 가능한 매핑이 생겼으니 백그라운드 기록 스레드를 깨움 */
+    if (writable)
+        vm_writeback_kick();
     return mapped_addr;
 	
 }
 
+/* Returns the file that backs PAGE, whether or not it has been
+ * faulted in yet, or a null pointer if PAGE is not file-backed. */
+static struct file *
+page_backing_file (struct page *page) {
+    if (page_get_type(page) != VM_FILE)
+        return NULL;
+    if (VM_TYPE(page->operations->type) == VM_UNINIT)
+        return ((struct file_meta_data *) page->uninit.aux)->file;
+    return page->file.file;
+}
+
 /* Do the munmap */
 void 
 do_munmap(void *addr) {
@@ -149,19 +194,38 @@ do_munmap(void *addr) {
 	 * 암시적이든 명시적이든 매핑이 매핑 해제되면 프로세스에서 쓴 모든 페이지는 파일에 다시 기록되며 기록되지 않은 페이지는 기록되지 않아야 합니다.
 	 * 그런 다음 해당 페이지는 프로세스의 가상 페이지 목록에서 제거됩니다.
 	 */
-	while (true) {
-		struct page* page = spt_find_page(&thread_current()->spt, addr);
+	struct supplemental_page_table *spt = &thread_current()->spt;
+	struct page *page = spt_find_page(spt, addr);
+	struct file *file = page != NULL ? page_backing_file(page) : NULL;
+
+	if (file == NULL)
+		return;
+
+	/* 같은 매핑(같은 file 객체)에 속한 페이지만 제거.
+	 * 기록은 file_backed_destroy에서, 프레임 반환은 vm_free_frame에서,
+	 * PTE 해제는 spt_remove_range에서 범위 단위로 처리 */
+	void *end = addr;
+	while (page != NULL && page_backing_file(page) == file) {
+		end += PGSIZE;
+		page = spt_find_page(spt, end);
+	}
+	spt_remove_range(spt, addr, end);
+}
 
-		if (page == NULL) {
-			break;
-		}
+/* Writes back the dirty resident pages mapped in [ADDR, ADDR + LENGTH).
+ * Returns false if ADDR is not inside a file mapping. */
+bool
+do_msync (void *addr, size_t length) {
+    struct supplemental_page_table *spt = &thread_current()->spt;
+    struct page *page = spt_find_page(spt, addr);
 
-		if (pml4_is_dirty(thread_current()->pml4, page->va)) {
-			struct file_page *file_page = &page->file;
-			file_write_at(file_page->file, page->va, file_page->page_read_bytes, file_page->ofs);
-			pml4_set_dirty(thread_current()->pml4, page->va, 0);
-		}
-		pml4_clear_page(thread_current()->pml4, page->va);
-		addr += PGSIZE;
-	}
+    if (page == NULL || page_get_type(page) != VM_FILE)
+        return false;
+
+    for (void *upage = pg_round_down(addr); upage < addr + length; upage += PGSIZE) {
+        page = spt_find_page(spt, upage);
+        if (page != NULL && page_get_type(page) == VM_FILE)
+            vm_writeback_page(page);
+    }
+    return true;
 }
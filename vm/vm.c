@@ -1,24 +1,197 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <stdio.h>
+#include <string.h>
+#include <syscall-nr.h>
 #include "threads/malloc.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
+#include "threads/synch.h"
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/inode.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
 #include "userprog/process.h"
 
+/* Global frame table: every user frame that currently backs a page.
+ * The clock hand sweeps over it to choose eviction victims. */
+static struct list frame_table;
+static struct list_elem *clock_hand;
+static struct lock frame_lock;
+
+/* Background reclaim.  When fewer than vm_low_watermark user frames
+ * are free, the reclaim daemon evicts in batches of RECLAIM_BATCH until
+ * vm_high_watermark frames are free again.  Set by "-vm-low" and
+ * "-vm-high"; a low watermark of 0 disables the daemon. */
+#define RECLAIM_BATCH 8
+size_t vm_low_watermark = 16;
+size_t vm_high_watermark = 32;
+static struct semaphore reclaim_sema;
+static bool reclaim_pending; /* Protected by frame_lock. */
+
+/* Statistics. */
+static long long evict_cnt;		  /* # of frames evicted. */
+static long long evict_ticks;	  /* # of timer ticks spent evicting. */
+static long long fault_cnt;		  /* # of page faults handled. */
+static long long sync_reclaim_cnt; /* # of frames evicted on the fault path. */
+static long long cow_share_cnt;	  /* # of pages shared by fork. */
+static long long cow_copy_cnt;	  /* # of copy-on-write faults that copied. */
+static long long cow_reuse_cnt;	  /* # of copy-on-write faults without a copy. */
+static long long text_share_cnt;  /* # of text pages mapped from the index. */
+static long long text_load_cnt;	  /* # of text pages read from the file. */
+static long long zero_map_cnt;	  /* # of read faults given the zero page. */
+static long long zero_copy_cnt;	  /* # of zero pages later written. */
+static long long around_cnt;	  /* # of pages mapped by fault-around. */
+static long long readahead_cnt;	  /* # of pages mapped by read-ahead. */
+static long long swap_ra_cnt;	  /* # of pages brought in by swap read-ahead. */
+static long long wb_bg_cnt;		  /* # of dirty file pages written in background. */
+static long long wb_msync_cnt;	  /* # of dirty file pages written by msync. */
+static long long populate_cnt;	  /* # of pages faulted in by populate/WILLNEED. */
+static long long dontneed_cnt;	  /* # of resident pages dropped by DONTNEED. */
+static long long huge_map_cnt;	  /* # of 2MB pages mapped. */
+static long long huge_fail_cnt;	  /* # of eligible blocks with no aligned run. */
+static long long rss_evict_cnt;	  /* # of frames recycled under an RSS cap. */
+static long long ksm_scan_cnt;	  /* # of frames hashed by the merge scanner. */
+static long long ksm_scan_ticks;  /* # of timer ticks spent scanning. */
+static long long ksm_merge_cnt;	  /* # of frames merged into an identical one. */
+static long long ksm_zero_cnt;	  /* # of frames of zeros replaced by the zero page. */
+static long long fork_cnt;		  /* # of address spaces copied by fork. */
+static long long fork_ticks;	  /* # of timer ticks spent copying them. */
+static long long teardown_cnt;	  /* # of address spaces torn down by exit/exec. */
+static long long teardown_ticks;  /* # of timer ticks spent tearing them down. */
+static long long cache_map_cnt;	  /* # of file pages mapped from the page cache. */
+
+/* Background writeback.  While writable file mappings exist, the
+ * writeback daemon wakes every WRITEBACK_INTERVAL ticks and writes dirty
+ * file-backed pages through the page cache, in file offset order with
+ * contiguous runs coalesced, so that munmap, exit and eviction find them
+ * mostly clean. */
+#define WRITEBACK_INTERVAL TIMER_FREQ
+static struct semaphore wb_sema;
+static bool wb_active; /* Protected by frame_lock. */
+
+/* Fault-around and read-ahead.  A fault on a page read from a file also
+ * maps the other pages of its FAULT_AROUND_PAGES-aligned block; a fault
+ * right after the previous batch is treated as a sequential scan and
+ * reads ahead a window that doubles up to READ_AHEAD_MAX pages. */
+#define FAULT_AROUND_PAGES 4
+#define READ_AHEAD_MAX 32
+
+/* Swap read-ahead: after a swap-in, up to SWAP_READ_AHEAD following
+ * pages whose slots follow the faulting page's slot are read too. */
+#define SWAP_READ_AHEAD 8
+
+/* Same-page merging.  With -ksm=PAGES, a daemon hashes up to PAGES
+ * anonymous frames every KSM_INTERVAL ticks and merges frames with
+ * identical contents into one read-only copy-on-write frame; frames
+ * of zeros are replaced by the zero page.  ksm_index holds the frames
+ * hashed in the current pass over the frame table. */
+#define KSM_INTERVAL (TIMER_FREQ / 10)
+size_t vm_ksm_pages;
+static struct hash ksm_index;
+static struct list_elem *ksm_cursor;
+static uint64_t ksm_zero_hash;
+static uint64_t ksm_hash_page(const void *kva);
+static uint64_t ksm_hash(const struct hash_elem *e, void *aux);
+static bool ksm_less(const struct hash_elem *a, const struct hash_elem *b,
+					 void *aux);
+static void vm_ksmd(void *aux);
+
+/* Transparent huge pages.  With -thp, a fault in a 2MB-aligned block
+ * of not yet loaded pages loads the whole block into one aligned run
+ * of the user pool and maps it with a single 2MB page. */
+#define HUGE_PAGES (HPGSIZE / PGSIZE)
+bool vm_huge_pages;
+
+/* The zero page: one read-only frame of zeros mapped by every
+ * anonymous page that has been read but never written.  It is not in
+ * the frame table and does not track its sharers. */
+static struct frame zero_frame;
+
+/* Shared text index: resident frames holding read-only executable
+ * pages, keyed by (inode sector, file offset, bytes read).  A process
+ * faulting on the same page of the same binary maps the existing frame
+ * instead of reading it again.  Protected by frame_lock. */
+static struct hash text_index;
+static uint64_t text_hash(const struct hash_elem *e, void *aux);
+static bool text_less(const struct hash_elem *a, const struct hash_elem *b,
+					  void *aux);
+
+static void vm_reclaimd(void *aux);
+static void vm_writebackd(void *aux);
+
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
 void vm_init(void)
 {
 	vm_anon_init();
 	vm_file_init();
-#ifdef EFILESYS /* For project 4 */
 	pagecache_init();
-#endif
 	register_inspect_intr();
 	/* DO NOT MODIFY UPPER LINES. */
 	/* TODO: Your code goes here. */
+	list_init(&frame_table);
+	lock_init(&frame_lock);
+	clock_hand = NULL;
+	hash_init(&text_index, text_hash, text_less, NULL);
+
+	zero_frame.kva = palloc_get_page(PAL_ZERO);
+	if (zero_frame.kva == NULL)
+		PANIC("Failed to allocate the zero page.");
+	list_init(&zero_frame.pages);
+	zero_frame.pinned = true;
+
+	sema_init(&reclaim_sema, 0);
+	if (vm_high_watermark < vm_low_watermark)
+		vm_high_watermark = vm_low_watermark;
+	if (vm_low_watermark > 0)
+		thread_create("vm_reclaimd", PRI_DEFAULT, vm_reclaimd, NULL);
+
+	sema_init(&wb_sema, 0);
+	thread_create("vm_writebackd", PRI_DEFAULT, vm_writebackd, NULL);
+
+	hash_init(&ksm_index, ksm_hash, ksm_less, NULL);
+	ksm_cursor = NULL;
+	ksm_zero_hash = ksm_hash_page(zero_frame.kva);
+	if (vm_ksm_pages > 0)
+		thread_create("vm_ksmd", PRI_DEFAULT, vm_ksmd, NULL);
+}
+
+/* Prints virtual memory statistics. */
+void vm_print_stats(void)
+{
+	printf("VM: %lld frames evicted in %lld ticks\n", evict_cnt, evict_ticks);
+	printf("VM: %lld of %lld page faults reclaimed synchronously (%lld%%)\n",
+		   sync_reclaim_cnt, fault_cnt,
+		   fault_cnt ? sync_reclaim_cnt * 100 / fault_cnt : 0);
+	printf("VM: %lld pages shared on fork, %lld copied on write, %lld reused\n",
+		   cow_share_cnt, cow_copy_cnt, cow_reuse_cnt);
+	printf("VM: %lld text pages mapped from shared frames, %lld read from disk\n",
+		   text_share_cnt, text_load_cnt);
+	printf("VM: %lld read faults mapped the zero page, %lld later written (%lld frames saved)\n",
+		   zero_map_cnt, zero_copy_cnt, zero_map_cnt - zero_copy_cnt);
+	printf("VM: %lld pages mapped by fault-around, %lld by read-ahead\n",
+		   around_cnt, readahead_cnt);
+	printf("VM: %lld pages brought in by swap read-ahead\n", swap_ra_cnt);
+	printf("VM: %lld dirty file pages written in background, %lld by msync\n",
+		   wb_bg_cnt, wb_msync_cnt);
+	printf("VM: %lld pages prefaulted by populate/willneed, %lld dropped by dontneed\n",
+		   populate_cnt, dontneed_cnt);
+	printf("VM: %lld 2MB pages mapped (%lld faults saved), %zu split, %lld fell back to 4KB\n",
+		   huge_map_cnt, huge_map_cnt * (HUGE_PAGES - 1), pml4_huge_split_cnt(),
+		   huge_fail_cnt);
+	printf("VM: %lld frames recycled by processes at their RSS cap\n",
+		   rss_evict_cnt);
+	printf("KSM: %lld frames scanned in %lld ticks, %lld merged, %lld into the zero page (%lld kB saved)\n",
+		   ksm_scan_cnt, ksm_scan_ticks, ksm_merge_cnt, ksm_zero_cnt,
+		   (ksm_merge_cnt + ksm_zero_cnt) * PGSIZE / 1024);
+	printf("VM: %lld address spaces copied by fork in %lld ticks, %lld torn down in %lld ticks\n",
+		   fork_cnt, fork_ticks, teardown_cnt, teardown_ticks);
+	printf("VM: %lld file pages mapped from the page cache\n", cache_map_cnt);
+	page_cache_print_stats();
+	file_backed_print_stats();
+	anon_print_stats();
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -38,9 +211,9 @@ page_get_type(struct page *page)
 }
 
 /* Helpers */
-static struct frame *vm_get_victim(void);
+static struct frame *vm_get_victim(struct thread *owner);
 static bool vm_do_claim_page(struct page *page);
-static struct frame *vm_evict_frame(void);
+static struct frame *vm_evict_frame(struct thread *owner);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -61,103 +234,1035 @@ bool vm_alloc_page_with_initializer(enum vm_type type, void *upage, bool writabl
 		struct page *p = (struct page *)malloc(sizeof(struct page));
 		bool (*page_initializer)(struct page *, enum vm_type, void *);
 
-		switch (VM_TYPE(type))
+		switch (VM_TYPE(type))
+		{
+		case VM_ANON:
+			page_initializer = anon_initializer;
+			break;
+		case VM_FILE:
+			page_initializer = file_backed_initializer;
+			break;
+		}
+
+		uninit_new(p, upage, init, type, aux, page_initializer);
+		p->writable = writable;
+		p->owner = thread_current();
+		p->advice = MADV_NORMAL;
+		if (VM_TYPE(type) == VM_FILE)
+			vm_account(&spt->mmap_cnt, 1);
+
+		/* TODO: Insert the page into the spt. */
+		return spt_insert_page(spt, p);
+	}
+err:
+	return false;
+}
+
+/* Find VA from spt and return page. On error, return NULL. */
+struct page *
+spt_find_page(struct supplemental_page_table *spt UNUSED, void *va UNUSED)
+{
+	/* TODO: Fill this function. */
+	/* 검색용 키는 스택에 두어 폴트마다 malloc 하지 않도록 함 */
+	struct page key;
+	struct hash_elem *e;
+
+	key.va = pg_round_down(va); 
+	e = hash_find(&spt->spt_hash, &key.hash_elem);
+
+	return e != NULL ? hash_entry(e, struct page, hash_elem) : NULL;
+}
+
+/* Insert PAGE into spt with validation. */
+bool spt_insert_page(struct supplemental_page_table *spt UNUSED,
+					 struct page *page UNUSED)
+{
+	/* TODO: Fill this function. */
+	struct hash_elem *e = hash_insert(&spt->spt_hash, &page->hash_elem);
+	return (e == NULL);}
+
+void spt_remove_page(struct supplemental_page_table *spt, struct page *page)
+{
+	hash_delete(&spt->spt_hash, &page->hash_elem);
+	if (page_get_type(page) == VM_FILE)
+		vm_account(&spt->mmap_cnt, -1);
+	lock_acquire(&frame_lock);
+	vm_dealloc_page(page);
+	lock_release(&frame_lock);
+}
+
+/* Removes the pages of the current process in [START, END) and unmaps
+ * the range with one pml4_clear_range() instead of page by page.
+ * frame_lock is held throughout, so no eviction can map a page back
+ * in between. */
+void spt_remove_range(struct supplemental_page_table *spt, void *start,
+					  void *end)
+{
+	uint64_t *pml4 = thread_current()->pml4;
+
+	ASSERT(spt == &thread_current()->spt);
+
+	lock_acquire(&frame_lock);
+	spt->unmap_deferred = true;
+	for (uint8_t *upage = start; upage < (uint8_t *)end; upage += PGSIZE)
+	{
+		struct page *page = spt_find_page(spt, upage);
+		if (page == NULL)
+			continue;
+		hash_delete(&spt->spt_hash, &page->hash_elem);
+		if (page_get_type(page) == VM_FILE)
+			vm_account(&spt->mmap_cnt, -1);
+		vm_dealloc_page(page);
+	}
+	spt->unmap_deferred = false;
+	if (pml4 != NULL)
+		pml4_clear_range(pml4, start, end);
+	lock_release(&frame_lock);
+}
+
+/* Advances the clock hand by one frame, wrapping around at the end
+ * of the frame table. */
+static struct frame *
+clock_advance(void)
+{
+	if (clock_hand == NULL || clock_hand == list_end(&frame_table))
+		clock_hand = list_begin(&frame_table);
+	struct frame *frame = list_entry(clock_hand, struct frame, frame_elem);
+	clock_hand = list_next(clock_hand);
+	return frame;
+}
+
+static uint64_t
+text_hash(const struct hash_elem *e, void *aux UNUSED)
+{
+	const struct frame *f = hash_entry(e, struct frame, text_elem);
+	uint64_t h = hash_int(f->text_inode);
+	h = h * 31 + hash_int(f->text_ofs);
+	return h * 31 + hash_int(f->text_read_bytes);
+}
+
+static bool
+text_less(const struct hash_elem *a_, const struct hash_elem *b_,
+		  void *aux UNUSED)
+{
+	const struct frame *a = hash_entry(a_, struct frame, text_elem);
+	const struct frame *b = hash_entry(b_, struct frame, text_elem);
+
+	if (a->text_inode != b->text_inode)
+		return a->text_inode < b->text_inode;
+	if (a->text_ofs != b->text_ofs)
+		return a->text_ofs < b->text_ofs;
+	return a->text_read_bytes < b->text_read_bytes;
+}
+
+/* If PAGE is a not yet loaded read-only executable page, fills in KEY's
+ * text index fields and returns true. */
+static bool
+text_page_key(struct page *page, struct frame *key)
+{
+	if (VM_TYPE(page->operations->type) != VM_UNINIT
+		|| !(page->uninit.type & VM_MARKER_1) || page->uninit.aux == NULL)
+		return false;
+
+	struct file_meta_data *meta = page->uninit.aux;
+	key->text_inode = inode_get_inumber(file_get_inode(meta->file));
+	key->text_ofs = meta->ofs;
+	key->text_read_bytes = meta->page_read_bytes;
+	return true;
+}
+
+/* Returns the indexed frame matching KEY, or NULL. */
+static struct frame *
+text_lookup(struct frame *key)
+{
+	struct hash_elem *e = hash_find(&text_index, &key->text_elem);
+	return e != NULL ? hash_entry(e, struct frame, text_elem) : NULL;
+}
+
+/* Removes FRAME from the frame table, keeping the clock hand valid. */
+static void
+frame_unlink(struct frame *frame)
+{
+	if (clock_hand == &frame->frame_elem)
+		clock_hand = list_next(clock_hand);
+	if (ksm_cursor == &frame->frame_elem)
+		ksm_cursor = list_next(ksm_cursor);
+	list_remove(&frame->frame_elem);
+
+	/* Its contents are about to change, so it can't be shared anymore. */
+	if (frame->text)
+	{
+		hash_delete(&text_index, &frame->text_elem);
+		frame->text = false;
+	}
+	if (frame->ksm)
+	{
+		hash_delete(&ksm_index, &frame->ksm_elem);
+		frame->ksm = false;
+	}
+}
+
+/* Adds DELTA to COUNTER, one of a process's memory counters.  Other
+ * processes update them as well when they evict its pages, not all
+ * under frame_lock, so interrupts are off around the update. */
+void vm_account(size_t *counter, int delta)
+{
+	enum intr_level old_level = intr_disable();
+	*counter += delta;
+	intr_set_level(old_level);
+}
+
+/* Returns true if T is at or over its resident-set cap. */
+static bool
+rss_at_limit(struct thread *t)
+{
+	return t->spt.rss_limit != 0 && t->spt.rss_cnt >= t->spt.rss_limit;
+}
+
+/* Makes PAGE the only user of FRAME. */
+static void
+frame_attach(struct frame *frame, struct page *page)
+{
+	frame->page = page;
+	frame->ref_cnt = 1;
+	list_init(&frame->pages);
+	list_push_back(&frame->pages, &page->share_elem);
+	page->frame = frame;
+	vm_account(&page->owner->spt.rss_cnt, 1);
+}
+
+/* Adds PAGE as one more copy-on-write sharer of FRAME. */
+static void
+frame_share(struct frame *frame, struct page *page)
+{
+	frame->ref_cnt++;
+	list_push_back(&frame->pages, &page->share_elem);
+	page->frame = frame;
+	vm_account(&page->owner->spt.rss_cnt, 1);
+}
+
+/* Clears PAGE's link to the frame it was attached to. */
+static void
+page_clear_frame(struct page *page)
+{
+	page->frame = NULL;
+	vm_account(&page->owner->spt.rss_cnt, -1);
+}
+
+/* Drops PAGE from the sharers of FRAME. */
+static void
+frame_unshare(struct frame *frame, struct page *page)
+{
+	ASSERT(frame->ref_cnt > 1);
+	list_remove(&page->share_elem);
+	frame->ref_cnt--;
+	if (frame->page == page)
+		frame->page = list_entry(list_front(&frame->pages), struct page, share_elem);
+	page_clear_frame(page);
+}
+
+/* Maps PAGE to FRAME in its owner's page table.  A frame that is still
+ * shared is mapped read-only so the first write faults into
+ * vm_handle_wp(), except for file pages: they share the page cache's
+ * frame on purpose.  Page cache pages are not mapped anywhere. */
+static bool
+page_map(struct page *page, struct frame *frame)
+{
+	uint64_t *pml4 = page->owner->pml4;
+	if (pml4 == NULL)
+		return true;
+
+	bool dirty = pml4_is_dirty(pml4, page->va);
+	bool rw = page->writable
+			  && (frame->ref_cnt == 1 || VM_TYPE(page->operations->type) == VM_FILE);
+
+	if (!pml4_set_page(pml4, page->va, frame->kva, rw))
+		return false;
+	if (dirty)
+		pml4_set_dirty(pml4, page->va, true);
+	return true;
+}
+
+/* Returns true if any page sharing FRAME was accessed since the last
+ * sweep, clearing the accessed bits as it goes. */
+static bool
+frame_test_and_clear_accessed(struct frame *frame)
+{
+	bool accessed = false;
+	struct list_elem *e;
+
+	for (e = list_begin(&frame->pages); e != list_end(&frame->pages); e = list_next(e))
+	{
+		struct page *page = list_entry(e, struct page, share_elem);
+		uint64_t *pml4 = page->owner->pml4;
+		if (pml4 == NULL)
+		{
+			/* Page cache pages are used by read() and write(). */
+			if (VM_TYPE(page->operations->type) == VM_PAGE_CACHE
+				&& page->page_cache.accessed)
+			{
+				page->page_cache.accessed = false;
+				accessed = true;
+			}
+			continue;
+		}
+		if (pml4_is_accessed(pml4, page->va))
+		{
+			/* A 2MB page has one accessed bit for all its frames.  Only
+			 * its first frame clears it, so the others are not picked
+			 * right after and the block keeps its second chance. */
+			if (((uint64_t)page->va & HPGMASK) == 0 || !pml4_is_huge(pml4, page->va))
+				pml4_set_accessed(pml4, page->va, false);
+			accessed = true;
+		}
+	}
+	return accessed;
+}
+
+/* Unmaps every page sharing FRAME, so their owners fault (and wait on
+ * frame_lock) instead of touching it while it is written out. */
+static void
+frame_unmap(struct frame *frame)
+{
+	struct list_elem *e;
+
+	for (e = list_begin(&frame->pages); e != list_end(&frame->pages); e = list_next(e))
+	{
+		struct page *page = list_entry(e, struct page, share_elem);
+		if (page->owner->pml4 != NULL)
+			pml4_clear_page(page->owner->pml4, page->va);
+	}
+}
+
+/* Undoes frame_unmap() after a failed swap out. */
+static void
+frame_remap(struct frame *frame)
+{
+	struct list_elem *e;
+
+	for (e = list_begin(&frame->pages); e != list_end(&frame->pages); e = list_next(e))
+		page_map(list_entry(e, struct page, share_elem), frame);
+}
+
+/* Finishes evicting FRAME once frame->page has been swapped out: the
+ * other anonymous sharers point at the same swap slot, file pages will
+ * find the page cache page again, and every page forgets the frame. */
+static void
+frame_release_pages(struct frame *frame)
+{
+	while (!list_empty(&frame->pages))
+	{
+		struct page *page = list_entry(list_pop_front(&frame->pages),
+									   struct page, share_elem);
+		if (page != frame->page && VM_TYPE(page->operations->type) == VM_ANON)
+			anon_swap_share(page, frame->page);
+		page_clear_frame(page);
+	}
+	frame->page = NULL;
+	frame->ref_cnt = 0;
+}
+
+/* Get the struct frame, that will be evicted.
+ * Second-chance clock: a frame whose page was accessed since the last
+ * sweep has its accessed bit cleared and is skipped once, unless the
+ * page was advised MADV_SEQUENTIAL.
+ * If OWNER is not null, only frames private to OWNER are considered.
+ * Must be called with frame_lock held. */
+static struct frame *
+vm_get_victim(struct thread *owner)
+{
+	struct frame *victim = NULL;
+	/* TODO: The policy for eviction is up to you. */
+	ASSERT(lock_held_by_current_thread(&frame_lock));
+
+	/* Two full sweeps are enough to find an unreferenced frame unless
+	 * everything is pinned. */
+	size_t sweep = 2 * list_size(&frame_table);
+	for (size_t i = 0; i < sweep; i++)
+	{
+		struct frame *frame = clock_advance();
+
+		if (frame->pinned)
+			continue;
+		if (owner != NULL && (frame->ref_cnt > 1 || frame->page->owner != owner))
+			continue;
+		/* Pages of a sequential scan are not coming back soon. */
+		if (frame_test_and_clear_accessed(frame)
+			&& frame->page->advice != MADV_SEQUENTIAL)
+			continue;
+		victim = frame;
+		break;
+	}
+	return victim;
+}
+
+/* Evict one page and return the corresponding frame.
+ * Return NULL on error.  OWNER is passed on to vm_get_victim().
+ * Must be called with frame_lock held. */
+static struct frame *
+vm_evict_frame(struct thread *owner)
+{
+	struct frame *victim UNUSED = vm_get_victim(owner);
+	/* TODO: swap out the victim and return the evicted frame. */
+	if (victim == NULL)
+		return NULL;
+
+	int64_t start = timer_ticks();
+
+	frame_unmap(victim);
+	if (!swap_out(victim->page))
+	{
+		frame_remap(victim);
+		return NULL;
+	}
+
+	frame_unlink(victim);
+	frame_release_pages(victim);
+
+	evict_cnt++;
+	evict_ticks += timer_elapsed(start);
+	return victim;
+}
+
+/* Orders pages by owner, then by address. */
+static bool
+page_swap_less(const struct page *a, const struct page *b)
+{
+	if (a->owner != b->owner)
+		return a->owner < b->owner;
+	return a->va < b->va;
+}
+
+/* Evicts up to RECLAIM_BATCH frames in one pass and returns them to the
+ * user pool.  Dirty anonymous victims are written to contiguous swap
+ * slots.  Returns the number of frames freed. */
+static size_t
+vm_reclaim_batch(void)
+{
+	struct frame *victims[RECLAIM_BATCH];
+	struct page *anon[RECLAIM_BATCH];
+	size_t victim_cnt = 0, anon_cnt = 0, freed = 0;
+
+	lock_acquire(&frame_lock);
+	int64_t start = timer_ticks();
+
+	/* Pinning keeps the clock from handing out the same frame twice. */
+	while (victim_cnt < RECLAIM_BATCH)
+	{
+		struct frame *frame = vm_get_victim(NULL);
+		if (frame == NULL)
+			break;
+		frame->pinned = true;
+		frame_unmap(frame);
+		victims[victim_cnt++] = frame;
+		if (page_get_type(frame->page) == VM_ANON)
+			anon[anon_cnt++] = frame->page;
+	}
+
+	/* Neighbouring pages of one process get neighbouring slots, so swap
+	 * read-ahead can bring them back together. */
+	for (size_t i = 1; i < anon_cnt; i++)
+		for (size_t j = i; j > 0 && page_swap_less(anon[j], anon[j - 1]); j--)
+		{
+			struct page *tmp = anon[j];
+			anon[j] = anon[j - 1];
+			anon[j - 1] = tmp;
+		}
+	if (anon_cnt > 0)
+		anon_swap_out_cluster(anon, anon_cnt);
+	for (size_t i = 0; i < victim_cnt; i++)
+	{
+		struct frame *frame = victims[i];
+		struct page *page = frame->page;
+		bool ok = page_get_type(page) == VM_ANON ? anon_is_swapped(page)
+												 : swap_out(page);
+
+		frame->pinned = false;
+		if (!ok)
+		{
+			frame_remap(frame);
+			continue;
+		}
+		frame_unlink(frame);
+		frame_release_pages(frame);
+		palloc_free_page(frame->kva);
+		free(frame);
+		freed++;
+	}
+
+	evict_cnt += freed;
+	evict_ticks += timer_elapsed(start);
+	lock_release(&frame_lock);
+	return freed;
+}
+
+/* Reclaim daemon: sleeps until the free frame count drops below the
+ * low watermark, then evicts in batches up to the high watermark so
+ * faulting threads rarely have to evict on their own. */
+static void
+vm_reclaimd(void *aux UNUSED)
+{
+	for (;;)
+	{
+		sema_down(&reclaim_sema);
+		while (palloc_user_free_pages() < vm_high_watermark)
+			if (vm_reclaim_batch() == 0)
+				break;
+
+		lock_acquire(&frame_lock);
+		reclaim_pending = false;
+		lock_release(&frame_lock);
+	}
+}
+
+/* Returns true if some file-backed page is resident. */
+static bool
+vm_file_pages_resident(void)
+{
+	struct list_elem *e;
+	bool any_file = false;
+
+	lock_acquire(&frame_lock);
+	for (e = list_begin(&frame_table); e != list_end(&frame_table) && !any_file;
+		 e = list_next(e))
+	{
+		struct page *page = list_entry(e, struct frame, frame_elem)->page;
+		any_file = VM_TYPE(page->operations->type) == VM_FILE;
+	}
+	lock_release(&frame_lock);
+	return any_file;
+}
+
+/* Writeback daemon: sleeps until a writable file mapping is created,
+ * then sweeps periodically until no file-backed page is resident. */
+static void
+vm_writebackd(void *aux UNUSED)
+{
+	for (;;)
+	{
+		sema_down(&wb_sema);
+		for (;;)
+		{
+			timer_sleep(WRITEBACK_INTERVAL);
+
+			/* File pages share their frames with the page cache, which
+			 * sees their dirty bits, writes contiguous runs at once and
+			 * holds no frame_lock during the I/O. */
+			size_t written = page_cache_flush();
+			lock_acquire(&frame_lock);
+			wb_bg_cnt += written;
+			lock_release(&frame_lock);
+			if (!vm_file_pages_resident())
+				break;
+		}
+
+		lock_acquire(&frame_lock);
+		wb_active = false;
+		lock_release(&frame_lock);
+	}
+}
+
+/* Starts periodic writeback if it is not running yet. */
+void vm_writeback_kick(void)
+{
+	lock_acquire(&frame_lock);
+	if (!wb_active)
+	{
+		wb_active = true;
+		sema_up(&wb_sema);
+	}
+	lock_release(&frame_lock);
+}
+
+/* Puts up to MAX dirty page cache pages into BATCH in file offset
+ * order, marks them clean and pins their frames, so that the page
+ * cache can write them back without frame_lock.  The caller must hold
+ * the page cache lock and count a pin on each page.  Returns the
+ * number of pages. */
+size_t vm_collect_dirty_cache(struct page **batch, size_t max)
+{
+	size_t cnt = 0;
+	struct list_elem *e;
+
+	lock_acquire(&frame_lock);
+	for (e = list_begin(&frame_table); e != list_end(&frame_table) && cnt < max;
+		 e = list_next(e))
+	{
+		struct page *page = list_entry(e, struct frame, frame_elem)->page;
+		if (VM_TYPE(page->operations->type) != VM_PAGE_CACHE
+			|| !page_cache_is_dirty(page))
+			continue;
+
+		size_t j = cnt++;
+		for (; j > 0 && page_cache_less(page, batch[j - 1]); j--)
+			batch[j] = batch[j - 1];
+		batch[j] = page;
+	}
+
+	for (size_t i = 0; i < cnt; i++)
+	{
+		page_cache_clean(batch[i]);
+		batch[i]->frame->pinned = true;
+	}
+	lock_release(&frame_lock);
+
+	return cnt;
+}
+
+/* Pins the frame of page cache PAGE, if it is resident, and marks it
+ * clean, so that the page cache can write it back without frame_lock
+ * before dropping it.  Returns true if it was dirty. */
+bool vm_pin_cache_page(struct page *page)
+{
+	bool dirty = false;
+
+	lock_acquire(&frame_lock);
+	if (page->frame != NULL)
+	{
+		dirty = page_cache_clean(page);
+		page->frame->pinned = true;
+	}
+	lock_release(&frame_lock);
+	return dirty;
+}
+
+/* Writes file-backed PAGE back now if it is resident and dirty, for
+ * msync.  The page cache pins the frame and writes it without
+ * frame_lock.  Returns true if it was written. */
+bool vm_writeback_page(struct page *page)
+{
+	if (VM_TYPE(page->operations->type) != VM_FILE)
+		return false;
+
+	bool written = page_cache_sync(file_get_inode(page->file.file),
+								   page->file.ofs);
+	if (written)
+	{
+		lock_acquire(&frame_lock);
+		wb_msync_cnt++;
+		lock_release(&frame_lock);
+	}
+	return written;
+}
+
+/* Hashes the page at KVA.  Four independent lanes of multiply-xor
+ * over 64-bit words keep the multiplier busy and would map onto
+ * vector lanes in a kernel built with SIMD. */
+static uint64_t
+ksm_hash_page(const void *kva)
+{
+	const uint64_t *w = kva;
+	uint64_t h0 = 1, h1 = 2, h2 = 3, h3 = 4;
+
+	for (size_t i = 0; i < PGSIZE / sizeof *w; i += 4)
+	{
+		h0 = (h0 ^ w[i]) * 0x9e3779b97f4a7c15ULL;
+		h1 = (h1 ^ w[i + 1]) * 0x9e3779b97f4a7c15ULL;
+		h2 = (h2 ^ w[i + 2]) * 0x9e3779b97f4a7c15ULL;
+		h3 = (h3 ^ w[i + 3]) * 0x9e3779b97f4a7c15ULL;
+	}
+	return h0 ^ (h1 << 1 | h1 >> 63) ^ (h2 << 2 | h2 >> 62) ^ (h3 << 3 | h3 >> 61);
+}
+
+static uint64_t
+ksm_hash(const struct hash_elem *e, void *aux UNUSED)
+{
+	return hash_entry(e, struct frame, ksm_elem)->ksm_hash;
+}
+
+/* Frames with the same content hash compare equal, so inserting a
+ * second one finds the first. */
+static bool
+ksm_less(const struct hash_elem *a, const struct hash_elem *b,
+		 void *aux UNUSED)
+{
+	return hash_entry(a, struct frame, ksm_elem)->ksm_hash
+		   < hash_entry(b, struct frame, ksm_elem)->ksm_hash;
+}
+
+static void
+ksm_forget(struct hash_elem *e, void *aux UNUSED)
+{
+	hash_entry(e, struct frame, ksm_elem)->ksm = false;
+}
+
+/* Returns true if FRAME may be merged: it holds writable anonymous
+ * pages only, of processes that are not exiting. */
+static bool
+ksm_candidate(struct frame *frame)
+{
+	struct list_elem *e;
+
+	if (frame->pinned || frame->text)
+		return false;
+	for (e = list_begin(&frame->pages); e != list_end(&frame->pages); e = list_next(e))
+	{
+		struct page *page = list_entry(e, struct page, share_elem);
+		if (VM_TYPE(page->operations->type) != VM_ANON || !page->writable
+			|| page->owner->pml4 == NULL)
+			return false;
+	}
+	return true;
+}
+
+/* Maps every page sharing FRAME read-only, so that its contents hold
+ * still while they are compared; frame_remap() undoes it. */
+static void
+frame_protect(struct frame *frame)
+{
+	struct list_elem *e;
+
+	for (e = list_begin(&frame->pages); e != list_end(&frame->pages); e = list_next(e))
+	{
+		struct page *page = list_entry(e, struct page, share_elem);
+		uint64_t *pml4 = page->owner->pml4;
+		bool dirty = pml4_is_dirty(pml4, page->va);
+
+		pml4_set_page(pml4, page->va, frame->kva, false);
+		if (dirty)
+			pml4_set_dirty(pml4, page->va, true);
+	}
+}
+
+/* Moves every page of FRAME to TARGET, the zero page or a frame with
+ * the same contents, and frees FRAME. */
+static void
+ksm_merge(struct frame *frame, struct frame *target)
+{
+	while (!list_empty(&frame->pages))
+	{
+		struct page *page = list_entry(list_pop_front(&frame->pages),
+									   struct page, share_elem);
+		page_clear_frame(page);
+		if (target == &zero_frame)
+		{
+			page->frame = &zero_frame;
+			pml4_set_page(page->owner->pml4, page->va, zero_frame.kva, false);
+		}
+		else
+			frame_share(target, page);
+	}
+	if (target != &zero_frame)
+		frame_protect(target);
+
+	frame_unlink(frame);
+	palloc_free_page(frame->kva);
+	free(frame);
+}
+
+/* Hashes FRAME and merges it with an identical frame hashed earlier
+ * in this pass, if any.  Must be called with frame_lock held. */
+static void
+ksm_scan_frame(struct frame *frame)
+{
+	frame->ksm_hash = ksm_hash_page(frame->kva);
+	ksm_scan_cnt++;
+
+	struct frame *other = &zero_frame;
+	if (frame->ksm_hash != ksm_zero_hash)
+	{
+		struct hash_elem *e = hash_insert(&ksm_index, &frame->ksm_elem);
+		if (e == NULL)
+		{
+			frame->ksm = true;
+			return;
+		}
+		other = hash_entry(e, struct frame, ksm_elem);
+		if (!ksm_candidate(other))
+			return;
+	}
+
+	/* Users write without frame_lock: compare only once neither frame
+	 * can change anymore. */
+	frame_protect(frame);
+	frame_protect(other);
+	if (memcmp(frame->kva, other->kva, PGSIZE) == 0)
+	{
+		ksm_merge(frame, other);
+		if (other == &zero_frame)
+			ksm_zero_cnt++;
+		else
+			ksm_merge_cnt++;
+		return;
+	}
+	frame_remap(frame);
+	if (other != &zero_frame)
+		frame_remap(other);
+}
+
+/* Scans up to vm_ksm_pages frames from where the last call stopped.
+ * A pass over the whole frame table starts with an empty index. */
+static void
+ksm_scan(void)
+{
+	lock_acquire(&frame_lock);
+	int64_t start = timer_ticks();
+
+	for (size_t i = 0; i < vm_ksm_pages && !list_empty(&frame_table); i++)
+	{
+		if (ksm_cursor == NULL || ksm_cursor == list_end(&frame_table))
+		{
+			hash_clear(&ksm_index, ksm_forget);
+			ksm_cursor = list_begin(&frame_table);
+		}
+		struct frame *frame = list_entry(ksm_cursor, struct frame, frame_elem);
+		ksm_cursor = list_next(ksm_cursor);
+
+		if (!frame->ksm && ksm_candidate(frame))
+			ksm_scan_frame(frame);
+	}
+
+	ksm_scan_ticks += timer_elapsed(start);
+	lock_release(&frame_lock);
+}
+
+/* Merge daemon. */
+static void
+vm_ksmd(void *aux UNUSED)
+{
+	for (;;)
+	{
+		timer_sleep(KSM_INTERVAL);
+		ksm_scan();
+	}
+}
+
+/* palloc() and get frame. If there is no available page, evict the page
+ * and return it. This always return valid address. That is, if the user pool
+ * memory is full, this function evicts the frame to get the available memory
+ * space.  A process at its RSS cap gets one of its own frames back.
+ * Must be called with frame_lock held. */
+static struct frame *
+vm_get_frame(void)
+{
+	struct frame *frame = NULL;
+
+	/* Over its RSS cap, the faulting process recycles one of its own
+	 * frames rather than take a free one or someone else's. */
+	if (rss_at_limit(thread_current()))
+	{
+		frame = vm_evict_frame(thread_current());
+		if (frame != NULL)
+			rss_evict_cnt++;
+	}
+
+	if (frame == NULL)
+	{
+		void *kva = palloc_get_page(PAL_USER); // 물리 메모리에 할당 -> 프레임
+
+		if (kva == NULL)
 		{
-		case VM_ANON:
-			page_initializer = anon_initializer;
-			break;
-		case VM_FILE:
-			page_initializer = file_backed_initializer;
-			break;
+			/* User pool is exhausted: reuse a victim's frame. */
+			frame = vm_evict_frame(NULL);
+			if (frame == NULL)
+				PANIC("Out of user frames and nothing to evict.");
+			sync_reclaim_cnt++;
 		}
+		else
+		{
+			frame = malloc(sizeof(struct frame)); // 가상 메모리에 할당 -> 페이지
+			if (frame == NULL)
+				PANIC("Failed to allocate memory for frame.");
+			frame->kva = kva;
+		}
+	}
 
-		uninit_new(p, upage, init, type, aux, page_initializer);
-		p->writable = writable;
+	frame->page = NULL;
+	frame->ref_cnt = 0;
+	frame->pinned = false;
+	frame->text = false;
+	frame->ksm = false;
 
-		/* TODO: Insert the page into the spt. */
-		return spt_insert_page(spt, p);
+	/* Running low: let the reclaim daemon refill the pool. */
+	if (vm_low_watermark > 0 && !reclaim_pending
+		&& palloc_user_free_pages() < vm_low_watermark)
+	{
+		reclaim_pending = true;
+		sema_up(&reclaim_sema);
 	}
-err:
-	return false;
+
+	ASSERT(frame != NULL);
+	ASSERT(frame->page == NULL);
+
+	return frame;
 }
 
-/* Find VA from spt and return page. On error, return NULL. */
-struct page *
-spt_find_page(struct supplemental_page_table *spt UNUSED, void *va UNUSED)
+/* Releases PAGE's hold on its frame, if any: unmaps it from the owner's
+ * page table and, unless other copy-on-write sharers remain, drops the
+ * frame from the frame table and frees the memory.
+ * Called from the page destroy handlers with frame_lock held. */
+void vm_free_frame(struct page *page)
 {
-	struct page *page = NULL;
-
-	/* TODO: Fill this function. */
-	page = (struct page *)malloc(sizeof(struct page));
-	struct hash_elem *e;
+	struct frame *frame = page->frame;
 
-	page->va = pg_round_down(va); 
-	e = hash_find(&spt->spt_hash, &page->hash_elem);
-	free(page);
+	ASSERT(lock_held_by_current_thread(&frame_lock));
+	if (frame == NULL)
+		return;
 
-	return e != NULL ? hash_entry(e, struct page, hash_elem) : NULL;
+	if (page->owner->pml4 != NULL && !page->owner->spt.unmap_deferred)
+		pml4_clear_page(page->owner->pml4, page->va);
+	if (frame == &zero_frame)
+	{
+		page->frame = NULL;
+		return;
+	}
+	if (frame->ref_cnt > 1)
+	{
+		frame_unshare(frame, page);
+		return;
+	}
+	frame_unlink(frame);
+	palloc_free_page(frame->kva);
+	free(frame);
+	page_clear_frame(page);
 }
 
-/* Insert PAGE into spt with validation. */
-bool spt_insert_page(struct supplemental_page_table *spt UNUSED,
-					 struct page *page UNUSED)
+/* Makes sure PAGE is resident and keeps it from being evicted until
+ * page_unpin(). Returns false if the page could not be brought in. */
+bool
+page_pin(struct page *page)
 {
-	/* TODO: Fill this function. */
-	struct hash_elem *e = hash_insert(&spt->spt_hash, &page->hash_elem);
-	return (e == NULL);}
+	for (;;)
+	{
+		lock_acquire(&frame_lock);
+		if (page->frame != NULL)
+		{
+			page->frame->pinned = true;
+			lock_release(&frame_lock);
+			return true;
+		}
+		lock_release(&frame_lock);
 
-void spt_remove_page(struct supplemental_page_table *spt, struct page *page)
-{
-	hash_delete(&spt->spt_hash, &page->hash_elem);
-	vm_dealloc_page(page);
-	return true;
+		/* It may be evicted again before we re-take the lock, so retry. */
+		if (!vm_do_claim_page(page))
+			return false;
+	}
 }
 
-/* Get the struct frame, that will be evicted. */
-static struct frame *
-vm_get_victim(void)
+void
+page_unpin(struct page *page)
 {
-	struct frame *victim = NULL;
-	/* TODO: The policy for eviction is up to you. */
-
-	return victim;
+	lock_acquire(&frame_lock);
+	if (page->frame != NULL)
+		page->frame->pinned = false;
+	lock_release(&frame_lock);
 }
 
-/* Evict one page and return the corresponding frame.
- * Return NULL on error.*/
-static struct frame *
-vm_evict_frame(void)
+/* Returns true if P can be part of a 2MB page next to WRITABLE
+ * pages: an anonymous page that was never loaded.  Text pages are
+ * left to the shared text index, and file pages map the page
+ * cache's frames. */
+static bool
+huge_page_ok(struct page *p, bool writable)
 {
-	struct frame *victim UNUSED = vm_get_victim();
-	/* TODO: swap out the victim and return the evicted frame. */
-
-	return NULL;
+	return p != NULL && p->frame == NULL && p->writable == writable
+		   && VM_TYPE(p->operations->type) == VM_UNINIT
+		   && VM_TYPE(p->uninit.type) == VM_ANON
+		   && !(p->uninit.type & VM_MARKER_1);
 }
 
-/* palloc() and get frame. If there is no available page, evict the page
- * and return it. This always return valid address. That is, if the user pool
- * memory is full, this function evicts the frame to get the available memory
- * space.*/
-static struct frame *
-vm_get_frame(void)
+/* Loads the whole 2MB-aligned block around PAGE and maps it with one
+ * 2MB page, if every page in the block qualifies for huge_page_ok()
+ * and the user pool has a free aligned run.  Each 4KB piece still
+ * gets its own struct frame, so eviction, copy-on-write and munmap
+ * keep working once the mmu splits the mapping under them.
+ * Returns false if PAGE still needs a 4KB claim. */
+static bool
+vm_map_huge(struct supplemental_page_table *spt, struct page *page)
 {
-    struct frame *frame = malloc(sizeof(struct frame)); // 가상 메모리에 할당 -> 페이지
-    if (frame == NULL) {
-        PANIC("Failed to allocate memory for frame.");
-    }
+	uint8_t *base = (uint8_t *)((uint64_t)page->va & ~HPGMASK);
+	size_t i, loaded;
 
-    frame->kva = palloc_get_page(PAL_USER); // 물리 메모리에 할당 -> 프레임
-    if (frame->kva == NULL) {
-        // Handle page eviction if no page is available.
-        PANIC("Need to implement page eviction.");
-    }
+	if (!is_user_vaddr(base + HPGSIZE - 1))
+		return false;
+	if (spt->rss_limit != 0 && spt->rss_cnt + HUGE_PAGES > spt->rss_limit)
+		return false;
+	for (i = 0; i < HUGE_PAGES; i++)
+		if (!huge_page_ok(spt_find_page(spt, base + i * PGSIZE), page->writable))
+			return false;
 
-	frame->page = NULL;
+	/* Never evict for a huge page; fall back to 4KB pages instead. */
+	uint8_t *kva = palloc_get_aligned(PAL_USER, HUGE_PAGES, HUGE_PAGES);
+	if (kva == NULL)
+	{
+		huge_fail_cnt++;
+		return false;
+	}
+
+	/* The frames are not in the frame table yet, so none of them can
+	 * be chosen as a victim while the block is read in. */
+	for (loaded = 0; loaded < HUGE_PAGES; loaded++)
+	{
+		struct page *p = spt_find_page(spt, base + loaded * PGSIZE);
+		struct frame *frame = malloc(sizeof(struct frame));
+		if (frame == NULL)
+			break;
+		frame->kva = kva + loaded * PGSIZE;
+		frame->pinned = false;
+		frame->text = false;
+		frame->ksm = false;
+		frame_attach(frame, p);
+		if (!swap_in(p, frame->kva))
+		{
+			page_clear_frame(p);
+			free(frame);
+			break;
+		}
+	}
 
-    ASSERT(frame != NULL);
-    ASSERT(frame->page == NULL);
+	lock_acquire(&frame_lock);
+	bool huge = loaded == HUGE_PAGES
+				&& pml4_set_huge_page(page->owner->pml4, base, kva, page->writable);
+	for (i = 0; i < loaded; i++)
+	{
+		struct page *p = spt_find_page(spt, base + i * PGSIZE);
+		/* Loaded only part of the block: map what we have page by page. */
+		if (!huge && !page_map(p, p->frame))
+		{
+			free(p->frame);
+			page_clear_frame(p);
+			palloc_free_page(kva + i * PGSIZE);
+			continue;
+		}
+		list_push_back(&frame_table, &p->frame->frame_elem);
+	}
+	if (huge)
+		huge_map_cnt++;
+	lock_release(&frame_lock);
+
+	for (i = loaded; i < HUGE_PAGES; i++)
+		palloc_free_page(kva + i * PGSIZE);
+	return page->frame != NULL;
+}
+
+/* Maps the zero page read-only at PAGE if it is an anonymous page
+ * that has never been touched or was discarded, so a read needs no
+ * frame of its own.
+ * Returns false if PAGE needs a real claim. */
+static bool
+vm_map_zero_page(struct page *page)
+{
+	bool fresh = VM_TYPE(page->operations->type) == VM_UNINIT
+				 && VM_TYPE(page->uninit.type) == VM_ANON
+				 && page->uninit.init == NULL;
+	/* Dropped by MADV_DONTNEED. */
+	bool discarded = VM_TYPE(page->operations->type) == VM_ANON
+					 && page->anon.discarded;
+	if (!fresh && !discarded)
+		return false;
 
-    return frame;
+	lock_acquire(&frame_lock);
+	bool ok = (!fresh || page->uninit.page_initializer(page, page->uninit.type, NULL))
+			  && pml4_set_page(page->owner->pml4, page->va, zero_frame.kva, false);
+	if (ok)
+	{
+		page->frame = &zero_frame;
+		if (discarded)
+			page->anon.discarded = false;
+		zero_map_cnt++;
+	}
+	lock_release(&frame_lock);
+	return ok;
 }
 
 /* Growing the stack. */
@@ -167,10 +1272,182 @@ vm_stack_growth(void *addr UNUSED)
 	vm_alloc_page(VM_ANON | VM_MARKER_0, addr, 1);
 }
 
-/* Handle the fault on write_protected page */
+/* Handle the fault on write_protected page.
+ * The page is copy-on-write: give it a private copy of the shared
+ * frame, or just make it writable if nobody else shares it anymore. */
 static bool
 vm_handle_wp(struct page *page UNUSED)
 {
+	lock_acquire(&frame_lock);
+	struct frame *old = page->frame;
+
+	/* Evicted between the fault and here: swap-in gives a private frame. */
+	if (old == NULL)
+	{
+		lock_release(&frame_lock);
+		return vm_do_claim_page(page);
+	}
+
+	/* First write to a page that was only read so far. */
+	if (old == &zero_frame)
+	{
+		struct frame *new = vm_get_frame();
+		memset(new->kva, 0, PGSIZE);
+		frame_attach(new, page);
+		bool ok = page_map(page, new);
+		if (ok)
+			list_push_back(&frame_table, &new->frame_elem);
+		zero_copy_cnt++;
+		lock_release(&frame_lock);
+		return ok;
+	}
+
+	/* A file page shares the page cache's frame for good: fork
+	 * write-protected it, and writing just needs the access back. */
+	if (VM_TYPE(page->operations->type) == VM_FILE)
+	{
+		bool ok = page_map(page, old);
+		lock_release(&frame_lock);
+		return ok;
+	}
+
+	if (old->ref_cnt == 1)
+	{
+		bool ok = page_map(page, old);
+		cow_reuse_cnt++;
+		lock_release(&frame_lock);
+		return ok;
+	}
+
+	/* Keep the shared frame from being evicted while we copy it. */
+	old->pinned = true;
+	struct frame *new = vm_get_frame();
+	old->pinned = false;
+
+	memcpy(new->kva, old->kva, PGSIZE);
+	frame_unshare(old, page);
+	frame_attach(new, page);
+	bool ok = page_map(page, new);
+	if (ok)
+		list_push_back(&frame_table, &new->frame_elem);
+
+	/* The last remaining sharer can have its write access back. */
+	if (old->ref_cnt == 1)
+		page_map(old->page, old);
+
+	cow_copy_cnt++;
+	lock_release(&frame_lock);
+	return ok;
+}
+
+/* Returns the file PAGE will be read from when it is claimed, or a
+ * null pointer if it is resident or bringing it in takes more than a
+ * file read (swap in, zero fill). */
+static struct file *
+page_read_file(struct page *page)
+{
+	if (page->frame != NULL)
+		return NULL;
+	switch (VM_TYPE(page->operations->type))
+	{
+	case VM_UNINIT:
+		/* lazy_load_segment() and mmap pages carry a file_meta_data. */
+		if (page->uninit.aux == NULL)
+			return NULL;
+		return ((struct file_meta_data *)page->uninit.aux)->file;
+	case VM_FILE:
+		return page->file.file;
+	default:
+		return NULL;
+	}
+}
+
+/* Maps the neighbours of VA, which was just faulted in from FILE:
+ * the rest of its fault-around block, or the read-ahead window if the
+ * fault continues a sequential scan or the page was advised
+ * MADV_SEQUENTIAL.  Only pages of the same file that are not resident
+ * yet are read, and never at the cost of an eviction. */
+static void
+vm_fault_around(struct supplemental_page_table *spt, void *va, struct file *file)
+{
+	struct page *page = spt_find_page(spt, va);
+	bool sequential = va == spt->ra_next || page->advice == MADV_SEQUENTIAL;
+	uint8_t *start, *end;
+
+	if (page->advice == MADV_SEQUENTIAL)
+	{
+		spt->ra_window = READ_AHEAD_MAX;
+		start = (uint8_t *)va + PGSIZE;
+		end = start + spt->ra_window * PGSIZE;
+	}
+	else if (sequential)
+	{
+		spt->ra_window = spt->ra_window == 0 ? FAULT_AROUND_PAGES
+											 : spt->ra_window * 2;
+		if (spt->ra_window > READ_AHEAD_MAX)
+			spt->ra_window = READ_AHEAD_MAX;
+		start = (uint8_t *)va + PGSIZE;
+		end = start + spt->ra_window * PGSIZE;
+	}
+	else
+	{
+		spt->ra_window = 0;
+		start = (uint8_t *)((uint64_t)va & ~((uint64_t)FAULT_AROUND_PAGES * PGSIZE - 1));
+		end = start + FAULT_AROUND_PAGES * PGSIZE;
+	}
+	spt->ra_next = (uint8_t *)va + PGSIZE;
+
+	for (uint8_t *upage = start; upage < end && is_user_vaddr(upage); upage += PGSIZE)
+	{
+		if (upage == va)
+			continue;
+		if (palloc_user_free_pages() <= vm_low_watermark
+			|| rss_at_limit(thread_current()))
+			break;
+
+		struct page *page = spt_find_page(spt, upage);
+		if (page == NULL || page_read_file(page) != file)
+		{
+			/* Past the end of the mapping: nothing more to read. */
+			if (upage > (uint8_t *)va)
+				break;
+			continue;
+		}
+		if (!vm_do_claim_page(page))
+			break;
+
+		if (sequential)
+			readahead_cnt++;
+		else
+			around_cnt++;
+		if (upage > (uint8_t *)va)
+			spt->ra_next = upage + PGSIZE;
+	}
+}
+
+/* After VA was swapped in from SLOT, reads in the following pages of
+ * the process that were swapped out to the following slots, while
+ * frames are free.  Their slots are adjacent on disk, so they most
+ * likely came from the same scan and will be touched next. */
+static void
+vm_swap_readahead(struct supplemental_page_table *spt, void *va, int slot)
+{
+	for (int i = 1; i <= SWAP_READ_AHEAD; i++)
+	{
+		void *upage = (uint8_t *)va + i * PGSIZE;
+		if (!is_user_vaddr(upage) || palloc_user_free_pages() <= vm_low_watermark
+			|| rss_at_limit(thread_current()))
+			break;
+
+		struct page *page = spt_find_page(spt, upage);
+		if (page == NULL || page->frame != NULL
+			|| VM_TYPE(page->operations->type) != VM_ANON
+			|| page->anon.swap_slot_no != slot + i)
+			break;
+		if (!vm_do_claim_page(page))
+			break;
+		swap_ra_cnt++;
+	}
 }
 
 /* Return true on success */
@@ -193,8 +1470,35 @@ bool vm_try_handle_fault(struct intr_frame *f UNUSED, void *addr UNUSED,
 	 * 유저 스택 포인터가 아닌 정의되지 않은 값 얻을 가능성 존재
 	*/
 	void *rsp = !user ? thread_current()->rsp : f->rsp;
+	fault_cnt++;
+
+	/* 쓰기 보호된 페이지에 쓰기: copy-on-write 처리 */
+	if (!not_present)
+	{
+		struct page *page = spt_find_page(spt, addr);
+		if (write && page != NULL && page->writable)
+			return vm_handle_wp(page);
+		return false;
+	}
+
 	if (not_present) 
 	{
+		struct page *page = spt_find_page(spt, addr);
+		struct file *file = page != NULL ? page_read_file(page) : NULL;
+
+		/* 2MB 정렬 구간 전체가 아직 로드되지 않았다면 큰 페이지 하나로 매핑 */
+		if (vm_huge_pages && page != NULL && vm_map_huge(spt, page))
+			return true;
+
+		/* 한 번도 쓰지 않은 익명 페이지를 읽기만 하면 제로 페이지를 공유 */
+		if (!write && page != NULL && vm_map_zero_page(page))
+			return true;
+
+		/* 스왑에서 읽어오는 익명 페이지라면 뒤따르는 슬롯도 미리 읽기 */
+		int slot = page != NULL && VM_TYPE(page->operations->type) == VM_ANON
+					   ? page->anon.swap_slot_no
+					   : -1;
+
 		/* 프레임 할당 실패 시 */
 		if (!vm_claim_page(addr)) {
 			/* 스택 증가로 Page Fault를 처리할 수 있는 경우 */
@@ -206,6 +1510,13 @@ bool vm_try_handle_fault(struct intr_frame *f UNUSED, void *addr UNUSED,
 			}
 			return false; 
 		}
+		/* 파일에서 읽어오는 페이지라면 이웃 페이지도 미리 매핑 */
+		if (page->advice == MADV_RANDOM)
+			return true;
+		if (file != NULL)
+			vm_fault_around(spt, page->va, file);
+		else if (slot >= 0)
+			vm_swap_readahead(spt, page->va, slot);
 		return true; // 프레임 할당 성공
 	}
 	return false;
@@ -219,6 +1530,15 @@ void vm_dealloc_page(struct page *page)
 	free(page);
 }
 
+/* Frees PAGE, which is in no supplemental page table, such as a page
+ * cache page. */
+void vm_destroy_page(struct page *page)
+{
+	lock_acquire(&frame_lock);
+	vm_dealloc_page(page);
+	lock_release(&frame_lock);
+}
+
 /* Claim the page that allocate on VA. */
 bool vm_claim_page(void *va UNUSED)
 {
@@ -229,20 +1549,203 @@ bool vm_claim_page(void *va UNUSED)
 	return vm_do_claim_page(page);
 }
 
-/* Claim the PAGE and set up the mmu. */
+/* Faults in every page of [ADDR, ADDR + LENGTH) that is not resident,
+ * for MAP_POPULATE and MADV_WILLNEED.  Unless FORCE, stops once free
+ * frames drop to the low watermark rather than evict for a hint.
+ * Returns the number of pages brought in. */
+size_t vm_populate(void *addr, size_t length, bool force)
+{
+	struct supplemental_page_table *spt = &thread_current()->spt;
+	uint8_t *end = (uint8_t *)addr + length;
+	size_t cnt = 0;
+
+	for (uint8_t *upage = pg_round_down(addr); upage < end; upage += PGSIZE)
+	{
+		struct page *page = spt_find_page(spt, upage);
+		if (page == NULL || page->frame != NULL)
+			continue;
+		if (!force && (palloc_user_free_pages() <= vm_low_watermark
+					   || rss_at_limit(thread_current())))
+			break;
+		if (!vm_do_claim_page(page))
+			break;
+		cnt++;
+	}
+	populate_cnt += cnt;
+	return cnt;
+}
+
+/* Drops the resident copy of PAGE for MADV_DONTNEED.  Anonymous pages
+ * that started out as zeros lose their contents, swap included, and
+ * read back as zeros; dirty file pages are written back first.
+ * Anonymous pages loaded from the executable, code or data, cannot be
+ * read again as they were, so they are kept.
+ * Must be called with frame_lock held. */
+static void
+page_dontneed(struct page *page)
+{
+	bool resident = page->frame != NULL;
+
+	switch (VM_TYPE(page->operations->type))
+	{
+	case VM_ANON:
+		if (!page->writable || !page->anon.zero_fill)
+			return;
+		anon_discard(page);
+		break;
+	case VM_FILE:
+		if (!resident)
+			return;
+		file_backed_writeback(page);
+		vm_free_frame(page);
+		break;
+	default:
+		return;
+	}
+	if (resident)
+		dontneed_cnt++;
+}
+
+/* Applies madvise() ADVICE to the pages of [ADDR, ADDR + LENGTH).
+ * There is no per-mapping object, so the advice is kept per page.
+ * Returns false if ADVICE is unknown. */
+bool vm_madvise(void *addr, size_t length, int advice)
+{
+	struct supplemental_page_table *spt = &thread_current()->spt;
+	uint8_t *end = (uint8_t *)addr + length;
+
+	switch (advice)
+	{
+	case MADV_NORMAL:
+	case MADV_RANDOM:
+	case MADV_SEQUENTIAL:
+		for (uint8_t *upage = addr; upage < end; upage += PGSIZE)
+		{
+			struct page *page = spt_find_page(spt, upage);
+			if (page != NULL)
+				page->advice = advice;
+		}
+		/* Start the next scan from a fresh read-ahead window. */
+		spt->ra_next = NULL;
+		spt->ra_window = 0;
+		return true;
+	case MADV_WILLNEED:
+		vm_populate(addr, length, false);
+		return true;
+	case MADV_DONTNEED:
+		lock_acquire(&frame_lock);
+		for (uint8_t *upage = addr; upage < end; upage += PGSIZE)
+		{
+			struct page *page = spt_find_page(spt, upage);
+			if (page != NULL)
+				page_dontneed(page);
+		}
+		lock_release(&frame_lock);
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* Maps file page PAGE to the page cache's frame for its file offset,
+ * bringing that in first if needed, so mmap, read() and write() all
+ * see the same copy. */
+static bool
+vm_map_cached(struct page *page)
+{
+	/* Transmute to a file page without running the lazy loader. */
+	if (VM_TYPE(page->operations->type) == VM_UNINIT
+		&& !page->uninit.page_initializer(page, page->uninit.type, NULL))
+		return false;
+
+	struct page *cache = page_cache_get(file_get_inode(page->file.file),
+										page->file.ofs);
+	if (cache == NULL)
+		return false;
+
+	lock_acquire(&frame_lock);
+	struct frame *frame = cache->frame;
+	frame_share(frame, page);
+	bool ok = page_map(page, frame);
+	if (ok)
+		cache_map_cnt++;
+	else
+		frame_unshare(frame, page);
+	lock_release(&frame_lock);
+
+	page_cache_put(cache);
+	return ok;
+}
+
+/* Claim the PAGE and set up the mmu.
+ * PAGE may belong to another process (e.g. the parent during fork), so
+ * the mapping goes into the owner's page table. */
 static bool vm_do_claim_page(struct page *page)
 {
+	struct frame key;
+	bool text = text_page_key(page, &key);
+
+	if (page_get_type(page) == VM_FILE)
+		return vm_map_cached(page);
+
+	/* Taking frame_lock also waits out an eviction of this very page
+	 * that may still be writing it to swap. */
+	lock_acquire(&frame_lock);
+
+	/* Another process already has this page of the binary in memory:
+	 * map its frame instead of reading the file again. */
+	struct frame *shared = text ? text_lookup(&key) : NULL;
+	if (shared != NULL)
+	{
+		/* Transmute to an anon page without running lazy_load_segment. */
+		bool ok = page->uninit.page_initializer(page, page->uninit.type, NULL);
+		if (ok)
+		{
+			frame_share(shared, page);
+			ok = page_map(page, shared);
+			if (!ok)
+				frame_unshare(shared, page);
+		}
+		if (ok)
+			text_share_cnt++;
+		lock_release(&frame_lock);
+		return ok;
+	}
+
 	struct frame *frame = vm_get_frame();
+	lock_release(&frame_lock);
 
 	/* Set links */
-	frame->page = page;
-	page->frame = frame;
+	frame_attach(frame, page);
+
+	/* The frame is not in the frame table yet, so it cannot be chosen
+	 * as a victim while its contents are being read in. */
+	if (!swap_in(page, frame->kva))
+		goto fail;
 
 	/* TODO: Insert page table entry to map page's VA to frame's PA. */
-	struct thread *current = thread_current();
-	pml4_set_page(current->pml4, page->va, frame->kva, page->writable);
+	if (!page_map(page, frame))
+		goto fail;
+
+	lock_acquire(&frame_lock);
+	list_push_back(&frame_table, &frame->frame_elem);
+	if (text)
+	{
+		text_load_cnt++;
+		/* Someone may have loaded the same page meanwhile; keep theirs. */
+		frame->text_inode = key.text_inode;
+		frame->text_ofs = key.text_ofs;
+		frame->text_read_bytes = key.text_read_bytes;
+		frame->text = hash_insert(&text_index, &frame->text_elem) == NULL;
+	}
+	lock_release(&frame_lock);
+	return true;
 
-	return swap_in(page, frame->kva);
+fail:
+	page_clear_frame(page);
+	palloc_free_page(frame->kva);
+	free(frame);
+	return false;
 }
 
 /* Returns a hash value for page p. */
@@ -267,6 +1770,74 @@ bool page_less(const struct hash_elem *a_,
 void supplemental_page_table_init(struct supplemental_page_table *spt UNUSED)
 {
 	hash_init(&spt->spt_hash, page_hash, page_less, NULL);
+	spt->ra_next = NULL;
+	spt->ra_window = 0;
+	/* rss_limit is left alone, so a cap survives exec. */
+	spt->rss_cnt = 0;
+	spt->swap_cnt = 0;
+	spt->mmap_cnt = 0;
+	spt->unmap_deferred = false;
+}
+
+/* Makes the child's anonymous page DST share SRC's contents
+ * copy-on-write instead of copying them: DST joins the sharers of a
+ * resident frame, and a swapped-out page just takes one more reference
+ * to its swap slot.  The page tables are done for all pages at once by
+ * cow_map_shared(). */
+static bool
+cow_share_page(struct page *dst, struct page *src)
+{
+	/* Turn the fresh uninit page into an empty anon page without
+	 * giving it a frame. */
+	if (!swap_in(dst, NULL))
+		return false;
+
+	lock_acquire(&frame_lock);
+	struct frame *frame = src->frame;
+
+	if (frame == &zero_frame)
+		dst->frame = frame;
+	else if (frame != NULL)
+		frame_share(frame, dst);
+	else if (anon_is_swapped(src))
+		anon_swap_share(dst, src);
+	/* Otherwise SRC was discarded and DST is as well. */
+	dst->anon.zero_fill = src->anon.zero_fill;
+	dst->anon.discarded = src->anon.discarded;
+
+	cow_share_cnt++;
+	lock_release(&frame_lock);
+	return true;
+}
+
+/* pml4_copy_range() filter: copies the parent's entry for VA if the
+ * child's page there (AUX is the child's table) shares its frame. */
+static bool
+cow_pte_shared(uint64_t *pte, void *va, void *aux)
+{
+	struct page *page = spt_find_page(aux, va);
+
+	return page != NULL && page->frame != NULL
+		   && page->frame->kva == ptov(PTE_ADDR(*pte));
+}
+
+/* Maps the frames the child shares with PARENT read-only into the
+ * child's page table and write-protects the parent's, one pass over
+ * each.  The parent's private pages are write-protected as well; their
+ * next write takes a fault that just restores write access. */
+static bool
+cow_map_shared(struct supplemental_page_table *dst, struct thread *parent)
+{
+	uint64_t *pml4 = thread_current()->pml4;
+
+	ASSERT(dst == &thread_current()->spt);
+
+	lock_acquire(&frame_lock);
+	bool ok = pml4_protect_range(parent->pml4, 0, (void *)KERN_BASE)
+			  && pml4_copy_range(pml4, parent->pml4, 0, (void *)KERN_BASE,
+								 cow_pte_shared, dst);
+	lock_release(&frame_lock);
+	return ok;
 }
 
 /* Copy supplemental page table from src to dst 
@@ -277,7 +1848,10 @@ bool supplemental_page_table_copy(struct supplemental_page_table *dst UNUSED,
 								  struct supplemental_page_table *src UNUSED)
 {
 	struct hash_iterator iter;
+	struct thread *parent = NULL;
+	int64_t start = timer_ticks();
 
+	dst->rss_limit = src->rss_limit;
 	hash_first(&iter, &src->spt_hash);
 
 	while (hash_next(&iter))
@@ -287,19 +1861,33 @@ bool supplemental_page_table_copy(struct supplemental_page_table *dst UNUSED,
 		void *upage = src_page->va;
 		bool writable = src_page->writable;
 
+		parent = src_page->owner;
 		if (type == VM_UNINIT)
 		{
 			vm_initializer *init = src_page->uninit.init;
 			void *aux = src_page->uninit.aux;
-			if (!vm_alloc_page_with_initializer(VM_ANON, upage, writable, init, aux))
+			if (!vm_alloc_page_with_initializer(src_page->uninit.type, upage, writable, init, aux))
+				return false;
+			spt_find_page(dst, upage)->advice = src_page->advice;
+			continue;
+		}
+
+		if (type == VM_ANON)
+		{
+			if (!vm_alloc_page(type, upage, writable))
 				return false;
-				
+			struct page *dst_page = spt_find_page(dst, upage);
+			if (dst_page == NULL || !cow_share_page(dst_page, src_page))
+				return false;
+			dst_page->advice = src_page->advice;
 			continue;
 		}
 
 		if (type == VM_FILE)
 		{
             struct file_meta_data *meta = malloc(sizeof(struct file_meta_data));
+			if (meta == NULL)
+				return false;
 
             meta->file = src_page->file.file;
             meta->ofs = src_page->file.ofs;
@@ -308,28 +1896,37 @@ bool supplemental_page_table_copy(struct supplemental_page_table *dst UNUSED,
 
             if (!vm_alloc_page_with_initializer(type, upage, writable, NULL, meta))
                 return false;
-
-            struct page *page = spt_find_page(dst, upage);
-            file_backed_initializer(page, type, NULL);
-            page->frame = src_page->frame;
-            pml4_set_page(thread_current()->pml4, page->va, src_page->frame->kva, src_page->writable);
-			
-            continue;
+			/* The child maps the same page cache frames when it faults. */
+			spt_find_page(dst, upage)->advice = src_page->advice;
+			continue;
 		}
 
-		if (!vm_alloc_page(type, upage, writable)) 
-			return false;
-
-		if (!vm_claim_page(upage))
+		if (!vm_alloc_page(type, upage, writable))
 			return false;
 
 		struct page *dst_page = spt_find_page(dst, upage);
 		if (dst_page == NULL)
 			return false;
+		dst_page->advice = src_page->advice;
 
+		/* The parent's page may be in swap, and claiming the child's
+		 * frame may evict it, so both are pinned around the copy. */
+		if (!page_pin(src_page))
+			return false;
+		if (!page_pin(dst_page))
+		{
+			page_unpin(src_page);
+			return false;
+		}
 		memcpy(dst_page->frame->kva, src_page->frame->kva, PGSIZE);
+		page_unpin(dst_page);
+		page_unpin(src_page);
 	}
 
+	if (parent != NULL && !cow_map_shared(dst, parent))
+		return false;
+	fork_cnt++;
+	fork_ticks += timer_elapsed(start);
 	return true;
 
 }
@@ -339,7 +1936,22 @@ void supplemental_page_table_kill(struct supplemental_page_table *spt UNUSED)
 {
 	/* TODO: Destroy all the supplemental_page_table hold by thread and
 	 * TODO: writeback all the modified contents to the storage. */
+	uint64_t *pml4 = thread_current()->pml4;
+	int64_t start = timer_ticks();
+
+	ASSERT(spt == &thread_current()->spt);
+
+	/* 페이지마다 PTE를 지우지 않고, 마지막에 사용자 영역 전체를 한 번에 해제 */
+	lock_acquire(&frame_lock);
+	spt->unmap_deferred = true;
 	hash_clear(&spt->spt_hash, spt_hash_destroy); // hash_destroy : 해시 테이블까지 삭제
+	spt->unmap_deferred = false;
+	if (pml4 != NULL)
+		pml4_destroy_range(pml4, 0, (void *)KERN_BASE);
+	lock_release(&frame_lock);
+
+	teardown_cnt++;
+	teardown_ticks += timer_elapsed(start);
 }
 
 void spt_hash_destroy(struct hash_elem *e, void *aux)
@@ -0,0 +1,389 @@
+/* zram.c: Compressed in-memory swap tier.
+ *
+ * anon_swap_out() offers each page here before going to the swap disk.
+ * The page is compressed with a small LZ77 coder (an LZ4-like format of
+ * literal runs and back references) and the result is kept in an arena
+ * of kernel pages, carved into 64-byte chunks.  Pages that do not shrink
+ * below ZRAM_MAX_OBJ bytes, or that do not fit under zram_cap_pages,
+ * are refused and the caller writes them to disk instead. */
+
+#include "vm/zram.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Arena geometry. */
+#define ZRAM_CHUNK 64
+#define ZRAM_CHUNKS (PGSIZE / ZRAM_CHUNK)	/* Chunks per arena page (64). */
+#define ZRAM_MAX_OBJ (PGSIZE * 3 / 4)		/* Largest object worth keeping. */
+
+/* Compressor parameters. */
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+
+size_t zram_cap_pages = 0;
+
+/* One kernel page of the arena. */
+struct zram_page
+{
+	struct list_elem elem;
+	uint8_t *base;		/* Kernel page holding the chunks. */
+	uint64_t used;		/* Bit I set if chunk I is allocated. */
+};
+
+struct zram_obj
+{
+	struct zram_page *zp;	/* Arena page holding the data. */
+	uint8_t chunk;			/* First chunk. */
+	uint8_t chunk_cnt;		/* Number of chunks. */
+	uint16_t len;			/* Compressed length in bytes. */
+	uint16_t ref;			/* Pages referring to this copy. */
+};
+
+static struct list zram_pages;
+static size_t zram_page_cnt;
+static struct lock zram_lock;
+
+/* Scratch space, protected by zram_lock. */
+static uint16_t lz_hash[1 << LZ_HASH_BITS];
+static uint8_t zbuf[ZRAM_MAX_OBJ];
+
+/* Statistics. */
+static long long store_cnt;			/* # of pages stored. */
+static long long stored_bytes;		/* Compressed bytes of those pages. */
+static long long full_cnt;			/* # of pages refused, tier full. */
+static long long poor_cnt;			/* # of pages refused, compressed poorly. */
+
+static size_t lz_compress(const uint8_t *src, size_t n, uint8_t *dst,
+		size_t cap);
+static bool lz_decompress(const uint8_t *src, size_t n, uint8_t *dst,
+		size_t cap);
+
+/* Initializes the tier. */
+void
+zram_init(void)
+{
+	list_init(&zram_pages);
+	lock_init(&zram_lock);
+}
+
+/* Finds CNT free consecutive chunks in ZP.  Returns the first, or -1. */
+static int
+chunk_find(const struct zram_page *zp, size_t cnt)
+{
+	uint64_t run = cnt == ZRAM_CHUNKS ? ~0ULL : (1ULL << cnt) - 1;
+
+	for (size_t i = 0; i + cnt <= ZRAM_CHUNKS; i++)
+		if (((zp->used >> i) & run) == 0)
+			return i;
+	return -1;
+}
+
+/* Allocates CNT chunks for OBJ, growing the arena up to the cap. */
+static bool
+chunk_alloc(struct zram_obj *obj, size_t cnt)
+{
+	struct zram_page *zp = NULL;
+	struct list_elem *e;
+	int chunk = -1;
+
+	for (e = list_begin(&zram_pages); e != list_end(&zram_pages);
+		 e = list_next(e))
+	{
+		zp = list_entry(e, struct zram_page, elem);
+		chunk = chunk_find(zp, cnt);
+		if (chunk >= 0)
+			break;
+	}
+
+	if (chunk < 0)
+	{
+		if (zram_page_cnt >= zram_cap_pages)
+			return false;
+		zp = malloc(sizeof *zp);
+		if (zp == NULL)
+			return false;
+		zp->base = palloc_get_page(0);
+		if (zp->base == NULL)
+		{
+			free(zp);
+			return false;
+		}
+		zp->used = 0;
+		list_push_back(&zram_pages, &zp->elem);
+		zram_page_cnt++;
+		chunk = 0;
+	}
+
+	zp->used |= ((cnt == ZRAM_CHUNKS ? ~0ULL : (1ULL << cnt) - 1) << chunk);
+	obj->zp = zp;
+	obj->chunk = chunk;
+	obj->chunk_cnt = cnt;
+	return true;
+}
+
+/* Releases OBJ's chunks, giving an emptied arena page back. */
+static void
+chunk_free(struct zram_obj *obj)
+{
+	struct zram_page *zp = obj->zp;
+	size_t cnt = obj->chunk_cnt;
+
+	zp->used &= ~((cnt == ZRAM_CHUNKS ? ~0ULL : (1ULL << cnt) - 1)
+			<< obj->chunk);
+	if (zp->used == 0)
+	{
+		list_remove(&zp->elem);
+		palloc_free_page(zp->base);
+		free(zp);
+		zram_page_cnt--;
+	}
+}
+
+/* Compresses the page at KVA into the tier.  Returns its handle with
+ * one reference, or a null pointer if the tier is disabled or full or
+ * the page does not compress well; the page then belongs on disk. */
+struct zram_obj *
+zram_store(const void *kva)
+{
+	if (zram_cap_pages == 0)
+		return NULL;
+
+	struct zram_obj *obj = malloc(sizeof *obj);
+	if (obj == NULL)
+		return NULL;
+
+	lock_acquire(&zram_lock);
+	size_t len = lz_compress(kva, PGSIZE, zbuf, sizeof zbuf);
+	if (len == 0)
+	{
+		poor_cnt++;
+		goto refuse;
+	}
+	if (!chunk_alloc(obj, DIV_ROUND_UP(len, ZRAM_CHUNK)))
+	{
+		full_cnt++;
+		goto refuse;
+	}
+	memcpy(obj->zp->base + obj->chunk * ZRAM_CHUNK, zbuf, len);
+	obj->len = len;
+	obj->ref = 1;
+	store_cnt++;
+	stored_bytes += len;
+	lock_release(&zram_lock);
+	return obj;
+
+refuse:
+	lock_release(&zram_lock);
+	free(obj);
+	return NULL;
+}
+
+/* Decompresses OBJ into the page at KVA. */
+void
+zram_load(struct zram_obj *obj, void *kva)
+{
+	lock_acquire(&zram_lock);
+	if (!lz_decompress(obj->zp->base + obj->chunk * ZRAM_CHUNK, obj->len,
+				kva, PGSIZE))
+		PANIC("zram: corrupted compressed page");
+	lock_release(&zram_lock);
+}
+
+/* Adds a reference to OBJ. */
+void
+zram_get(struct zram_obj *obj)
+{
+	lock_acquire(&zram_lock);
+	ASSERT(obj->ref > 0);
+	obj->ref++;
+	lock_release(&zram_lock);
+}
+
+/* Drops a reference to OBJ, freeing it with the last one. */
+void
+zram_put(struct zram_obj *obj)
+{
+	lock_acquire(&zram_lock);
+	ASSERT(obj->ref > 0);
+	bool last = --obj->ref == 0;
+	if (last)
+		chunk_free(obj);
+	lock_release(&zram_lock);
+	if (last)
+		free(obj);
+}
+
+/* Prints tier statistics. */
+void
+zram_print_stats(void)
+{
+	long long orig = store_cnt * PGSIZE;
+
+	printf("zram: %lld pages stored, %lld bytes -> %lld bytes "
+			"(ratio %lld.%02lld), %zu arena pages in use\n",
+			store_cnt, orig, stored_bytes,
+			stored_bytes ? orig / stored_bytes : 0,
+			stored_bytes ? orig * 100 / stored_bytes % 100 : 0,
+			zram_page_cnt);
+	printf("zram: %lld pages refused as tier full, %lld as poorly "
+			"compressible\n", full_cnt, poor_cnt);
+}
+
+/* LZ coder.
+ *
+ * The output is a series of sequences.  Each one starts with a token
+ * byte whose high nibble is the literal count and whose low nibble is
+ * the match length minus LZ_MIN_MATCH; a nibble of 15 continues in
+ * following bytes, each added in, until one is not 255.  The literals
+ * come next, then a 2-byte little-endian match offset.  The last
+ * sequence stops after its literals. */
+
+static uint32_t
+read32(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof v);
+	return v;
+}
+
+/* Appends the extension bytes for a nibble-overflowing length LEN. */
+static bool
+lz_put_len(uint8_t *dst, size_t cap, size_t *op, size_t len)
+{
+	for (len -= 15; ; len -= 255)
+	{
+		if (*op >= cap)
+			return false;
+		dst[(*op)++] = len >= 255 ? 255 : len;
+		if (len < 255)
+			return true;
+	}
+}
+
+/* Appends one sequence: LIT_LEN literals from LIT, then a match of
+ * MATCH_LEN bytes at OFFSET back, or no match if MATCH_LEN is 0. */
+static bool
+lz_emit(uint8_t *dst, size_t cap, size_t *op, const uint8_t *lit,
+		size_t lit_len, size_t offset, size_t match_len)
+{
+	size_t mcode = match_len ? match_len - LZ_MIN_MATCH : 0;
+
+	if (*op >= cap)
+		return false;
+	dst[(*op)++] = (lit_len < 15 ? lit_len : 15) << 4
+		| (mcode < 15 ? mcode : 15);
+	if (lit_len >= 15 && !lz_put_len(dst, cap, op, lit_len))
+		return false;
+	if (*op + lit_len > cap)
+		return false;
+	memcpy(dst + *op, lit, lit_len);
+	*op += lit_len;
+
+	if (match_len == 0)
+		return true;
+	if (*op + 2 > cap)
+		return false;
+	dst[(*op)++] = offset & 0xff;
+	dst[(*op)++] = offset >> 8;
+	return mcode < 15 || lz_put_len(dst, cap, op, mcode);
+}
+
+/* Compresses N bytes at SRC into DST, which holds CAP bytes.  Returns
+ * the compressed length, or 0 if it would not fit in CAP. */
+static size_t
+lz_compress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap)
+{
+	size_t ip = 0, anchor = 0, op = 0;
+
+	ASSERT(n <= UINT16_MAX);
+	memset(lz_hash, 0, sizeof lz_hash);
+	while (ip + LZ_MIN_MATCH <= n)
+	{
+		uint32_t seq = read32(src + ip);
+		size_t h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+		size_t ref = lz_hash[h];
+
+		lz_hash[h] = ip;
+		if (ref < ip && read32(src + ref) == seq)
+		{
+			size_t len = LZ_MIN_MATCH;
+			while (ip + len < n && src[ref + len] == src[ip + len])
+				len++;
+			if (!lz_emit(dst, cap, &op, src + anchor, ip - anchor,
+						ip - ref, len))
+				return 0;
+			ip += len;
+			anchor = ip;
+		}
+		else
+			ip++;
+	}
+	if (!lz_emit(dst, cap, &op, src + anchor, n - anchor, 0, 0))
+		return 0;
+	return op;
+}
+
+/* Reads the extension bytes of a length whose nibble was 15, starting
+ * at SRC[*IP], into *LEN. */
+static bool
+lz_get_len(const uint8_t *src, size_t n, size_t *ip, size_t *len)
+{
+	uint8_t b;
+
+	*len = 15;
+	do
+	{
+		if (*ip >= n)
+			return false;
+		b = src[(*ip)++];
+		*len += b;
+	} while (b == 255);
+	return true;
+}
+
+/* Decompresses N bytes at SRC into DST, which must come out exactly
+ * CAP bytes long.  Returns false if the input is malformed. */
+static bool
+lz_decompress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap)
+{
+	size_t ip = 0, op = 0;
+
+	while (ip < n)
+	{
+		uint8_t token = src[ip++];
+		size_t lit_len = token >> 4;
+		size_t match_len = token & 15;
+
+		if (lit_len == 15 && !lz_get_len(src, n, &ip, &lit_len))
+			return false;
+		if (ip + lit_len > n || op + lit_len > cap)
+			return false;
+		memcpy(dst + op, src + ip, lit_len);
+		ip += lit_len;
+		op += lit_len;
+		if (ip == n)
+			break;
+
+		if (ip + 2 > n)
+			return false;
+		size_t offset = src[ip] | src[ip + 1] << 8;
+		ip += 2;
+		if (match_len == 15 && !lz_get_len(src, n, &ip, &match_len))
+			return false;
+		match_len += LZ_MIN_MATCH;
+		if (offset == 0 || offset > op || op + match_len > cap)
+			return false;
+		/* Byte by byte: the match may overlap what it produces. */
+		for (size_t i = 0; i < match_len; i++, op++)
+			dst[op] = dst[op - offset];
+	}
+	return op == cap;
+}